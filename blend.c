@@ -0,0 +1,177 @@
+#include <math.h>
+#include <string.h>
+
+#include "blend.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define BLEND_X86
+#include <immintrin.h>
+#endif
+
+#define LIN_MAX 4095
+
+typedef void (*kernel_t)(uint32_t *p, const unsigned char *m, int n, uint32_t fg);
+
+static struct {
+	kernel_t kernel;
+	const char *name;
+	/* 8-bit values to linear light and back, for gamma */
+	uint16_t tolin[256];
+	unsigned char togam[LIN_MAX + 1];
+} bl;
+
+/* (t + (t >> 8)) >> 8 divides by 255 with rounding for t < 65536, once 128
+ * has been added, and keeps every intermediate within 16 bits. */
+static uint32_t
+blendpixel(uint32_t b, uint32_t f, unsigned a) {
+	uint32_t out = 0;
+	for (int shift = 0; shift < 32; shift += 8) {
+		unsigned t = (f >> shift & 0xff) * a + (b >> shift & 0xff) * (255 - a) + 128;
+		out |= (uint32_t)((t + (t >> 8)) >> 8) << shift;
+	}
+	return out;
+}
+
+static void
+scalar(uint32_t *p, const unsigned char *m, int n, uint32_t fg) {
+	for (int i = 0; i < n; ++i) {
+		if (m[i] == 255) {
+			p[i] = fg;
+		} else if (m[i]) {
+			p[i] = blendpixel(p[i], fg, m[i]);
+		}
+	}
+}
+
+static void
+linear(uint32_t *p, const unsigned char *m, int n, uint32_t fg) {
+	for (int i = 0; i < n; ++i) {
+		unsigned a = m[i];
+		uint32_t out = 0;
+		if (a == 255) {
+			p[i] = fg;
+			continue;
+		} else if (!a) {
+			continue;
+		}
+		for (int shift = 0; shift < 32; shift += 8) {
+			unsigned l = (bl.tolin[fg >> shift & 0xff] * a
+			           + bl.tolin[p[i] >> shift & 0xff] * (255 - a) + 127) / 255;
+			out |= (uint32_t)bl.togam[l] << shift;
+		}
+		p[i] = out;
+	}
+}
+
+#ifdef BLEND_X86
+/* The same arithmetic as blendpixel, on 16-bit lanes. */
+__attribute__((target("sse2")))
+static inline __m128i
+blend16(__m128i b, __m128i f, __m128i a) {
+	__m128i t = _mm_add_epi16(_mm_mullo_epi16(f, a),
+	                          _mm_mullo_epi16(b, _mm_sub_epi16(_mm_set1_epi16(255), a)));
+	t = _mm_add_epi16(t, _mm_set1_epi16(128));
+	return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+__attribute__((target("sse2")))
+static void
+sse2(uint32_t *p, const unsigned char *m, int n, uint32_t fg) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i f = _mm_unpacklo_epi8(_mm_set1_epi32((int)fg), zero);
+	int i = 0;
+	for (; i + 4 <= n; i += 4) {
+		uint32_t m4;
+		memcpy(&m4, m + i, sizeof(m4));
+		if (!m4) {
+			continue;
+		} else if (m4 == 0xffffffff) {
+			_mm_storeu_si128((__m128i*)(p + i), _mm_set1_epi32((int)fg));
+			continue;
+		}
+		/* each mask byte spread over the four bytes of its pixel */
+		__m128i a = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128((int)m4), zero), zero);
+		a = _mm_or_si128(a, _mm_slli_epi32(a, 8));
+		a = _mm_or_si128(a, _mm_slli_epi32(a, 16));
+		__m128i d = _mm_loadu_si128((const __m128i*)(p + i));
+		__m128i lo = blend16(_mm_unpacklo_epi8(d, zero), f, _mm_unpacklo_epi8(a, zero));
+		__m128i hi = blend16(_mm_unpackhi_epi8(d, zero), f, _mm_unpackhi_epi8(a, zero));
+		_mm_storeu_si128((__m128i*)(p + i), _mm_packus_epi16(lo, hi));
+	}
+	scalar(p + i, m + i, n - i, fg);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i
+blend16x2(__m256i b, __m256i f, __m256i a) {
+	__m256i t = _mm256_add_epi16(_mm256_mullo_epi16(f, a),
+	                             _mm256_mullo_epi16(b, _mm256_sub_epi16(_mm256_set1_epi16(255), a)));
+	t = _mm256_add_epi16(t, _mm256_set1_epi16(128));
+	return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+}
+
+__attribute__((target("avx2")))
+static void
+avx2(uint32_t *p, const unsigned char *m, int n, uint32_t fg) {
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i f = _mm256_unpacklo_epi8(_mm256_set1_epi32((int)fg), zero);
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		uint64_t m8;
+		memcpy(&m8, m + i, sizeof(m8));
+		if (!m8) {
+			continue;
+		} else if (m8 == UINT64_MAX) {
+			_mm256_storeu_si256((__m256i*)(p + i), _mm256_set1_epi32((int)fg));
+			continue;
+		}
+		/* unpacking works within 128-bit halves, which pixels and mask
+		 * share alike */
+		__m256i a = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(m + i)));
+		a = _mm256_or_si256(a, _mm256_slli_epi32(a, 8));
+		a = _mm256_or_si256(a, _mm256_slli_epi32(a, 16));
+		__m256i d = _mm256_loadu_si256((const __m256i*)(p + i));
+		__m256i lo = blend16x2(_mm256_unpacklo_epi8(d, zero), f, _mm256_unpacklo_epi8(a, zero));
+		__m256i hi = blend16x2(_mm256_unpackhi_epi8(d, zero), f, _mm256_unpackhi_epi8(a, zero));
+		_mm256_storeu_si256((__m256i*)(p + i), _mm256_packus_epi16(lo, hi));
+	}
+	sse2(p + i, m + i, n - i, fg);
+}
+#endif
+
+void
+blendinit(double g) {
+	bl.kernel = scalar;
+	bl.name = "scalar";
+	if (g > 0 && g != 1) {
+		for (int i = 0; i < 256; ++i) {
+			bl.tolin[i] = (uint16_t)lround(pow(i / 255.0, g) * LIN_MAX);
+		}
+		for (int i = 0; i <= LIN_MAX; ++i) {
+			bl.togam[i] = (unsigned char)lround(pow((double)i / LIN_MAX, 1 / g) * 255);
+		}
+		bl.kernel = linear;
+		bl.name = "scalar, gamma";
+		return;
+	}
+#ifdef BLEND_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		bl.kernel = avx2;
+		bl.name = "avx2";
+	} else if (__builtin_cpu_supports("sse2")) {
+		bl.kernel = sse2;
+		bl.name = "sse2";
+	}
+#endif
+}
+
+const char *
+blendname() {
+	return bl.name;
+}
+
+void
+blendspan(uint32_t *p, const unsigned char *m, int n, uint32_t fg) {
+	bl.kernel(p, m, n, fg);
+}
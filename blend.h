@@ -0,0 +1,20 @@
+/* Blending a color over 32-bit pixels through an 8-bit coverage mask, a
+ * byte per color channel. The kernel is chosen once for the CPU: AVX2 or
+ * SSE2 where there are, scalar otherwise, all with the same results. */
+
+#ifndef BLEND_H
+#define BLEND_H
+
+#include <stdint.h>
+
+/* Choose the kernel. A gamma other than 1 blends in linear light through
+ * lookup tables, which only the scalar kernel does. Call it before any
+ * blendspan, from one thread. */
+void blendinit(double gamma);
+/* The name of the chosen kernel. */
+const char *blendname(void);
+/* Each byte of the n pixels at p becomes fg * m / 255 + p * (255 - m) / 255,
+ * rounded, m being the mask byte of the pixel. */
+void blendspan(uint32_t *p, const unsigned char *m, int n, uint32_t fg);
+
+#endif
@@ -0,0 +1,143 @@
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "evloop.h"
+
+#define MAXEVENTS 8
+
+struct source_t {
+	int fd;
+	evcb_t cb;
+	evsigcb_t sigcb;
+	void *arg;
+	struct source_t *next;
+};
+
+static struct {
+	int fd;
+	struct source_t *sources;
+} loop = {
+	.fd = -1,
+};
+
+int
+evinit() {
+	if ((loop.fd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+		return -1;
+	}
+	return 0;
+}
+
+static struct source_t *
+addsource(int fd, unsigned events) {
+	struct source_t *src;
+	struct epoll_event ev = { .events = events };
+
+	if (fd < 0 || !(src = calloc(1, sizeof(*src)))) {
+		errno = fd < 0 ? EBADF : ENOMEM;
+		return NULL;
+	}
+	src->fd = fd;
+	ev.data.ptr = src;
+	if (epoll_ctl(loop.fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+		free(src);
+		return NULL;
+	}
+	src->next = loop.sources;
+	loop.sources = src;
+	return src;
+}
+
+int
+evadd(int fd, unsigned events, evcb_t cb, void *arg) {
+	struct source_t *src;
+	if (!(src = addsource(fd, events))) {
+		return -1;
+	}
+	src->cb = cb;
+	src->arg = arg;
+	return 0;
+}
+
+int
+evdel(int fd) {
+	for (struct source_t **p = &loop.sources; *p; p = &(*p)->next) {
+		if ((*p)->fd == fd) {
+			struct source_t *src = *p;
+			*p = src->next;
+			free(src);
+			return epoll_ctl(loop.fd, EPOLL_CTL_DEL, fd, NULL);
+		}
+	}
+	errno = ENOENT;
+	return -1;
+}
+
+int
+evsignal(const int *sigs, int n, evsigcb_t cb, void *arg) {
+	struct source_t *src;
+	sigset_t set;
+	int fd;
+
+	sigemptyset(&set);
+	for (int i = 0; i < n; ++i) {
+		sigaddset(&set, sigs[i]);
+	}
+	if (sigprocmask(SIG_BLOCK, &set, NULL) < 0
+	 || (fd = signalfd(-1, &set, SFD_NONBLOCK | SFD_CLOEXEC)) < 0) {
+		return -1;
+	}
+	if (!(src = addsource(fd, EPOLLIN))) {
+		close(fd);
+		return -1;
+	}
+	src->sigcb = cb;
+	src->arg = arg;
+	return 0;
+}
+
+static void
+dispatch(struct source_t *src, unsigned events) {
+	if (src->sigcb) {
+		struct signalfd_siginfo si;
+		while (read(src->fd, &si, sizeof(si)) == sizeof(si)) {
+			src->sigcb(si.ssi_signo, src->arg);
+		}
+	} else if (src->cb) {
+		src->cb(src->fd, events, src->arg);
+	}
+}
+
+int
+evwait(int timeout) {
+	struct epoll_event ev[MAXEVENTS];
+	int n;
+
+	if ((n = epoll_wait(loop.fd, ev, MAXEVENTS, timeout)) < 0) {
+		return -1;
+	}
+	for (int i = 0; i < n; ++i) {
+		dispatch(ev[i].data.ptr, ev[i].events);
+	}
+	return n;
+}
+
+void
+evcleanup() {
+	while (loop.sources) {
+		struct source_t *src = loop.sources;
+		loop.sources = src->next;
+		if (src->sigcb) {
+			close(src->fd);
+		}
+		free(src);
+	}
+	if (loop.fd >= 0) {
+		close(loop.fd);
+		loop.fd = -1;
+	}
+}
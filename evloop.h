@@ -0,0 +1,23 @@
+/* An epoll loop over file descriptors with callbacks. Signals are turned
+ * into a source of their own through signalfd, so that callbacks never
+ * run in signal context. */
+
+#ifndef EVLOOP_H
+#define EVLOOP_H
+
+typedef void (*evcb_t)(int fd, unsigned events, void *arg);
+typedef void (*evsigcb_t)(int signo, void *arg);
+
+int evinit(void);
+/* Watch fd for events (EPOLLIN etc.). cb may be NULL if waking up is
+ * all that is needed. */
+int evadd(int fd, unsigned events, evcb_t cb, void *arg);
+int evdel(int fd);
+/* Block the n signals in sigs and deliver them to cb instead. */
+int evsignal(const int *sigs, int n, evsigcb_t cb, void *arg);
+/* Wait once, for at most timeout ms (-1 for ever), and dispatch what is
+ * ready. Returns the number of ready sources, or -1 with errno set. */
+int evwait(int timeout);
+void evcleanup(void);
+
+#endif
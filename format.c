@@ -0,0 +1,343 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "format.h"
+
+enum {
+	F_SEC,
+	F_MIN,
+	F_HOUR,
+	F_HOUR12,
+	F_MDAY,
+	F_MON,
+	F_YEAR,
+	F_YEAR2,
+	F_CENT,
+	F_YDAY,
+	F_WDAY,
+	F_WDAY1,
+};
+
+static const struct {
+	char conv;
+	int field;
+	int width;
+	char pad;
+} numbers[] = {
+	{ 'S', F_SEC,    2, '0' },
+	{ 'M', F_MIN,    2, '0' },
+	{ 'H', F_HOUR,   2, '0' },
+	{ 'k', F_HOUR,   2, ' ' },
+	{ 'I', F_HOUR12, 2, '0' },
+	{ 'l', F_HOUR12, 2, ' ' },
+	{ 'd', F_MDAY,   2, '0' },
+	{ 'e', F_MDAY,   2, ' ' },
+	{ 'm', F_MON,    2, '0' },
+	{ 'Y', F_YEAR,   1, '0' },
+	{ 'y', F_YEAR2,  2, '0' },
+	{ 'C', F_CENT,   2, '0' },
+	{ 'j', F_YDAY,   3, '0' },
+	{ 'w', F_WDAY,   1, '0' },
+	{ 'u', F_WDAY1,  1, '0' },
+};
+
+/* Fields of struct tm that a conversion reads. */
+static unsigned
+convdeps(char c) {
+	switch (c) {
+	case 'S':
+		return TM_SEC;
+	case 'M':
+		return TM_MIN;
+	case 'H': case 'k': case 'I': case 'l': case 'p': case 'P':
+		return TM_HOUR;
+	case 'R':
+		return TM_HOUR | TM_MIN;
+	case 'T': case 'r': case 'X':
+		return TM_HOUR | TM_MIN | TM_SEC;
+	case 'a': case 'A': case 'w': case 'u':
+		return TM_WDAY;
+	case 'b': case 'B': case 'h': case 'm':
+		return TM_MON;
+	case 'd': case 'e':
+		return TM_MDAY;
+	case 'j':
+		return TM_YDAY;
+	case 'Y': case 'y': case 'C':
+		return TM_YEAR;
+	case 'D': case 'F': case 'x': case 'G': case 'g': case 'V': case 'U': case 'W':
+		return TM_DATE;
+	case 'z': case 'Z':
+		return TM_ZONE;
+	default:
+		return TM_ALL;
+	}
+}
+
+static unsigned
+tmdiff(const struct tm *a, const struct tm *b) {
+	unsigned d = 0;
+	d |= a->tm_sec  != b->tm_sec  ? TM_SEC  : 0;
+	d |= a->tm_min  != b->tm_min  ? TM_MIN  : 0;
+	d |= a->tm_hour != b->tm_hour ? TM_HOUR : 0;
+	d |= a->tm_mday != b->tm_mday ? TM_MDAY : 0;
+	d |= a->tm_mon  != b->tm_mon  ? TM_MON  : 0;
+	d |= a->tm_year != b->tm_year ? TM_YEAR : 0;
+	d |= a->tm_wday != b->tm_wday ? TM_WDAY : 0;
+	d |= a->tm_yday != b->tm_yday ? TM_YDAY : 0;
+	d |= a->tm_isdst != b->tm_isdst || a->tm_gmtoff != b->tm_gmtoff
+	  || a->tm_zone != b->tm_zone ? TM_ZONE : 0;
+	return d;
+}
+
+static int
+fieldval(int field, const struct tm *tm) {
+	switch (field) {
+	case F_SEC:    return tm->tm_sec;
+	case F_MIN:    return tm->tm_min;
+	case F_HOUR:   return tm->tm_hour;
+	case F_HOUR12: return tm->tm_hour % 12 ? tm->tm_hour % 12 : 12;
+	case F_MDAY:   return tm->tm_mday;
+	case F_MON:    return tm->tm_mon + 1;
+	case F_YEAR:   return tm->tm_year + 1900;
+	case F_YEAR2:  return ((tm->tm_year + 1900) % 100 + 100) % 100;
+	case F_CENT:   return (tm->tm_year + 1900) / 100;
+	case F_YDAY:   return tm->tm_yday + 1;
+	case F_WDAY:   return tm->tm_wday;
+	case F_WDAY1:  return tm->tm_wday ? tm->tm_wday : 7;
+	default:       return 0;
+	}
+}
+
+static size_t
+fmtnum(char *out, int v, int width, char pad) {
+	char tmp[16];
+	size_t n = 0, len = 0;
+	bool neg = v < 0;
+	unsigned u = neg ? -(unsigned)v : (unsigned)v;
+	do {
+		tmp[n++] = '0' + u % 10;
+		u /= 10;
+	} while (u);
+	if (neg) {
+		tmp[n++] = '-';
+	}
+	for (; (int)n < width; --width) {
+		out[len++] = pad;
+	}
+	while (n) {
+		out[len++] = tmp[--n];
+	}
+	out[len] = '\0';
+	return len;
+}
+
+static size_t
+renderop(struct fmtop_t *op, const struct tm *tm, long nsec, char *out) {
+	switch (op->type) {
+	case OP_FRAC:
+		for (int i = op->width; i < 9; ++i) {
+			nsec /= 10;
+		}
+		return fmtnum(out, (int)nsec, op->width, '0');
+	case OP_NUMBER:
+		return fmtnum(out, fieldval(op->field, tm), op->width, op->pad);
+	case OP_NAME: {
+		int i = op->field == F_WDAY ? tm->tm_wday
+		      : op->field == F_MON  ? tm->tm_mon
+		      : tm->tm_hour >= 12;
+		if (i < 0 || i >= 12) {
+			i = 0;
+		}
+		strcpy(out, op->names[i]);
+		return strlen(out);
+	}
+	case OP_STRFTIME: {
+		size_t len = strftime(out, FMT_OUTSZ, op->spec, tm);
+		out[len] = '\0';
+		return len;
+	}
+	default:
+		return op->len;
+	}
+}
+
+static struct fmtop_t *
+addop(struct fmt_t *fmt) {
+	struct fmtop_t *ops;
+	if (!(ops = realloc(fmt->ops, (fmt->n + 1) * sizeof(*ops)))) {
+		return NULL;
+	}
+	fmt->ops = ops;
+	memset(&ops[fmt->n], 0, sizeof(*ops));
+	return &ops[fmt->n++];
+}
+
+static bool
+addliteral(struct fmt_t *fmt, const char *s, size_t len) {
+	struct fmtop_t *op = fmt->n ? &fmt->ops[fmt->n - 1] : NULL;
+	if (!op || op->type != OP_LITERAL) {
+		if (!(op = addop(fmt))) {
+			return false;
+		}
+		op->type = OP_LITERAL;
+	}
+	if (op->len + len >= FMT_OUTSZ) {
+		return false;
+	}
+	memcpy(op->out + op->len, s, len);
+	op->len += len;
+	op->out[op->len] = '\0';
+	return true;
+}
+
+/* Localized names are looked up once, by formatting every value. */
+static bool
+mknames(struct fmtop_t *op, char conv) {
+	struct tm tm = { 0 };
+	int n;
+	if (strchr("aA", conv)) {
+		op->field = F_WDAY;
+		n = 7;
+	} else if (strchr("bBh", conv)) {
+		op->field = F_MON;
+		n = 12;
+	} else if (strchr("pP", conv)) {
+		op->field = F_HOUR;
+		n = 2;
+	} else {
+		return false;
+	}
+	if (!(op->names = calloc(n, sizeof(*op->names)))) {
+		return false;
+	}
+	for (int i = 0; i < n; ++i) {
+		tm.tm_wday = i;
+		tm.tm_mon = i;
+		tm.tm_hour = i * 12;
+		strftime(op->names[i], sizeof(op->names[i]), op->spec, &tm);
+	}
+	op->type = OP_NAME;
+	return true;
+}
+
+bool
+fmtcompile(struct fmt_t *fmt, const char *spec) {
+	memset(fmt, 0, sizeof(*fmt));
+	for (const char *p = spec; *p; ) {
+		if (*p != '%') {
+			size_t len = strcspn(p, "%");
+			if (!addliteral(fmt, p, len)) {
+				goto fail;
+			}
+			p += len;
+			continue;
+		}
+		const char *q = p + 1;
+		q += strspn(q, "_-0^#");
+		q += strspn(q, "0123456789");
+		if (*q == 'E' || *q == 'O') {
+			++q;
+		}
+		if (!*q) {
+			goto fail;
+		}
+		char conv = *q++;
+		size_t speclen = q - p;
+		if (speclen == 2 && strchr("%nt", conv)) {
+			if (!addliteral(fmt, conv == '%' ? "%" : conv == 'n' ? "\n" : "\t", 1)) {
+				goto fail;
+			}
+			p = q;
+			continue;
+		}
+
+		struct fmtop_t *op;
+		if (speclen >= sizeof(op->spec) || !(op = addop(fmt))) {
+			goto fail;
+		}
+		memcpy(op->spec, p, speclen);
+		if (conv == 'N') {
+			/* strftime has no %N; the width is the number of digits */
+			int digits = atoi(p + 1);
+			op->type = OP_FRAC;
+			op->deps = TM_FRAC;
+			op->width = digits < 1 || digits > 9 ? 9 : digits;
+			fmt->deps |= op->deps;
+			fmt->digits = op->width > fmt->digits ? op->width : fmt->digits;
+			p = q;
+			continue;
+		}
+		op->deps = convdeps(conv);
+		op->type = OP_STRFTIME;
+		if (!mknames(op, conv) && speclen == 2) {
+			for (size_t i = 0; i < sizeof(numbers) / sizeof(numbers[0]); ++i) {
+				if (numbers[i].conv == conv) {
+					op->type = OP_NUMBER;
+					op->field = numbers[i].field;
+					op->width = numbers[i].width;
+					op->pad = numbers[i].pad;
+				}
+			}
+		}
+		fmt->deps |= op->deps;
+		p = q;
+	}
+	return true;
+fail:
+	fmtfree(fmt);
+	return false;
+}
+
+bool
+fmtrender(struct fmt_t *fmt, const struct tm *tm, long nsec, char *buf, size_t size) {
+	unsigned changed = fmt->valid ? tmdiff(&fmt->last, tm) : TM_ALL | TM_FRAC;
+	bool dirty = !fmt->valid;
+	char out[FMT_OUTSZ];
+
+	if (fmt->valid && fmt->lastns != nsec) {
+		changed |= TM_FRAC;
+	}
+	fmt->last = *tm;
+	fmt->lastns = nsec;
+	fmt->valid = true;
+	if (!(changed & fmt->deps) && !dirty) {
+		return false;
+	}
+	for (int i = 0; i < fmt->n; ++i) {
+		struct fmtop_t *op = &fmt->ops[i];
+		if (op->type == OP_LITERAL || !(op->deps & changed)) {
+			continue;
+		}
+		size_t len = renderop(op, tm, nsec, out);
+		if (len != op->len || memcmp(out, op->out, len)) {
+			memcpy(op->out, out, len + 1);
+			op->len = len;
+			dirty = true;
+		}
+	}
+	if (!dirty) {
+		return false;
+	}
+
+	size_t len = 0;
+	for (int i = 0; i < fmt->n && len + 1 < size; ++i) {
+		size_t n = fmt->ops[i].len;
+		if (len + n + 1 > size) {
+			n = size - len - 1;
+		}
+		memcpy(buf + len, fmt->ops[i].out, n);
+		len += n;
+	}
+	buf[len] = '\0';
+	return true;
+}
+
+void
+fmtfree(struct fmt_t *fmt) {
+	for (int i = 0; i < fmt->n; ++i) {
+		free(fmt->ops[i].names);
+	}
+	free(fmt->ops);
+	memset(fmt, 0, sizeof(*fmt));
+}
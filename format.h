@@ -0,0 +1,70 @@
+/* strftime(3) formats compiled into a list of operations. Each operation
+ * knows which fields of struct tm it depends on, so that rendering a new
+ * time only redoes the operations whose fields have changed.
+ *
+ * As an extension, %N gives the fraction of the second, and %1N to %9N
+ * give it to that many digits, like date(1). */
+
+#ifndef FORMAT_H
+#define FORMAT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+
+enum {
+	TM_SEC  = 1 << 0,
+	TM_MIN  = 1 << 1,
+	TM_HOUR = 1 << 2,
+	TM_MDAY = 1 << 3,
+	TM_MON  = 1 << 4,
+	TM_YEAR = 1 << 5,
+	TM_WDAY = 1 << 6,
+	TM_YDAY = 1 << 7,
+	TM_ZONE = 1 << 8,
+	TM_DATE = TM_MDAY | TM_MON | TM_YEAR | TM_WDAY | TM_YDAY,
+	TM_ALL  = (1 << 9) - 1,
+	/* not a field of struct tm, but the nanoseconds beside it */
+	TM_FRAC = 1 << 9,
+};
+
+#define FMT_OUTSZ 64
+
+struct fmtop_t {
+	enum {
+		OP_LITERAL,
+		OP_NUMBER,
+		OP_NAME,
+		OP_STRFTIME,
+		OP_FRAC,
+	} type;
+	unsigned deps;
+	char spec[16];
+	int field;
+	int width;
+	char pad;
+	char (*names)[FMT_OUTSZ];
+	char out[FMT_OUTSZ];
+	size_t len;
+};
+
+struct fmt_t {
+	struct fmtop_t *ops;
+	int n;
+	unsigned deps;
+	/* most digits of a second shown by any %N */
+	int digits;
+	bool valid;
+	struct tm last;
+	long lastns;
+};
+
+/* Compile spec; returns false if it cannot be represented. */
+bool fmtcompile(struct fmt_t *fmt, const char *spec);
+/* Write the formatted time to buf, nsec being the fraction of the second
+ * for %N. Returns false if nothing changed since the previous call, in
+ * which case buf is left alone. */
+bool fmtrender(struct fmt_t *fmt, const struct tm *tm, long nsec, char *buf, size_t size);
+void fmtfree(struct fmt_t *fmt);
+
+#endif
@@ -0,0 +1,105 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "pool.h"
+
+static struct {
+	pthread_t *threads;
+	int nthreads;
+	pthread_mutex_t lock;
+	pthread_cond_t work;
+	pthread_cond_t done;
+	pooljob_t job;
+	char *args;
+	size_t size;
+	int n;
+	int next;
+	int pending;
+	bool quit;
+} pool = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.work = PTHREAD_COND_INITIALIZER,
+	.done = PTHREAD_COND_INITIALIZER,
+};
+
+/* Run jobs of the current batch until none are left to start. Called
+ * and returns with the lock held. */
+static void
+take() {
+	while (pool.next < pool.n) {
+		void *arg = pool.args + pool.next++ * pool.size;
+		pthread_mutex_unlock(&pool.lock);
+		pool.job(arg);
+		pthread_mutex_lock(&pool.lock);
+		if (!--pool.pending) {
+			pthread_cond_signal(&pool.done);
+		}
+	}
+}
+
+static void *
+worker(void *unused) {
+	pthread_mutex_lock(&pool.lock);
+	while (!pool.quit) {
+		if (pool.next < pool.n) {
+			take();
+		} else {
+			pthread_cond_wait(&pool.work, &pool.lock);
+		}
+	}
+	pthread_mutex_unlock(&pool.lock);
+	return NULL;
+}
+
+int
+poolinit(int n) {
+	int e;
+	if (n > 0 && !(pool.threads = calloc(n, sizeof(*pool.threads)))) {
+		return -1;
+	}
+	for (; pool.nthreads < n; ++pool.nthreads) {
+		if ((e = pthread_create(&pool.threads[pool.nthreads], NULL, worker, NULL))) {
+			poolcleanup();
+			errno = e;
+			return -1;
+		}
+	}
+	return 0;
+}
+
+void
+poolrun(pooljob_t job, void *args, size_t size, int n) {
+	pthread_mutex_lock(&pool.lock);
+	pool.job = job;
+	pool.args = args;
+	pool.size = size;
+	pool.n = n;
+	pool.next = 0;
+	pool.pending = n;
+	if (pool.nthreads && n > 1) {
+		pthread_cond_broadcast(&pool.work);
+	}
+	take();
+	while (pool.pending) {
+		pthread_cond_wait(&pool.done, &pool.lock);
+	}
+	pool.n = 0;
+	pthread_mutex_unlock(&pool.lock);
+}
+
+void
+poolcleanup() {
+	pthread_mutex_lock(&pool.lock);
+	pool.quit = true;
+	pthread_cond_broadcast(&pool.work);
+	pthread_mutex_unlock(&pool.lock);
+	for (int i = 0; i < pool.nthreads; ++i) {
+		pthread_join(pool.threads[i], NULL);
+	}
+	free(pool.threads);
+	pool.threads = NULL;
+	pool.nthreads = 0;
+	pool.quit = false;
+}
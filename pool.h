@@ -0,0 +1,19 @@
+/* A few worker threads that run a batch of jobs and are waited for as a
+ * whole. The calling thread works on the batch too. Workers inherit the
+ * signal mask of the thread that starts them. */
+
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+
+typedef void (*pooljob_t)(void *arg);
+
+/* Start n workers, which may be 0. Returns -1 with errno set on failure. */
+int poolinit(int n);
+/* Call job on each of the n elements of size bytes at args, and return
+ * when all calls have. */
+void poolrun(pooljob_t job, void *args, size_t size, int n);
+void poolcleanup(void);
+
+#endif
@@ -0,0 +1,141 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "blend.h"
+#include "raster.h"
+
+/* Render the coverage of a glyph into a mask the size of the ink box
+ * that Xft reports, so that what is drawn stays inside what is measured. */
+static bool
+rasterize(struct rglyph_t *g, Display *dpy, XftFont *xfont) {
+	FT_UInt index = XftCharIndex(dpy, xfont, g->ucs);
+	FT_Face face;
+	int w, h;
+
+	XftGlyphExtents(dpy, xfont, &index, 1, &g->ext);
+	w = g->ext.width;
+	h = g->ext.height;
+	if (!w || !h) {
+		return true;
+	}
+	if (!(g->mask = calloc(w * h, 1)) || !(face = XftLockFace(xfont))) {
+		return false;
+	}
+	if (!FT_Load_Glyph(face, index, FT_LOAD_RENDER)) {
+		const FT_Bitmap *bm = &face->glyph->bitmap;
+		bool mono = bm->pixel_mode == FT_PIXEL_MODE_MONO;
+		int ox = face->glyph->bitmap_left + g->ext.x;
+		int oy = g->ext.y - face->glyph->bitmap_top;
+		for (int r = 0; r < (int)bm->rows; ++r) {
+			const unsigned char *row = bm->buffer + r * bm->pitch;
+			if (oy + r < 0 || oy + r >= h) {
+				continue;
+			}
+			for (int c = 0; c < (int)bm->width; ++c) {
+				if (ox + c < 0 || ox + c >= w) {
+					continue;
+				}
+				g->mask[(oy + r) * w + ox + c] = mono ? (row[c / 8] >> (7 - c % 8) & 1) * 255 : row[c];
+			}
+		}
+	}
+	XftUnlockFace(xfont);
+	return true;
+}
+
+static int
+rfind(const struct rfont_t *font, FcChar32 ucs) {
+	for (int i = 0; i < font->n; ++i) {
+		if (font->glyph[i].ucs == ucs) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+int
+rlayout(struct rfont_t *font, Display *dpy, XftFont *xfont, const char *s, int *idx, int max) {
+	int len = strlen(s), k, n = 0;
+	FcChar32 ucs;
+	for (; len > 0; s += k, len -= k) {
+		if ((k = FcUtf8ToUcs4((const FcChar8*)s, &ucs, len)) <= 0 || n == max) {
+			return -1;
+		}
+		int i = rfind(font, ucs);
+		if (i < 0) {
+			struct rglyph_t *glyph;
+			if (!(glyph = realloc(font->glyph, (font->n + 1) * sizeof(*glyph)))) {
+				return -1;
+			}
+			font->glyph = glyph;
+			i = font->n;
+			memset(&glyph[i], 0, sizeof(*glyph));
+			glyph[i].ucs = ucs;
+			if (!rasterize(&glyph[i], dpy, xfont)) {
+				free(glyph[i].mask);
+				return -1;
+			}
+			++font->n;
+		}
+		idx[n++] = i;
+	}
+	return n;
+}
+
+/* Clip the box from x1, y1 to x2, y2 to clip and to the image. */
+static bool
+rclip(const struct rimage_t *img, const XRectangle *clip, int *x1, int *y1, int *x2, int *y2) {
+	int cx2 = clip->x + clip->width, cy2 = clip->y + clip->height;
+	*x1 = *x1 > clip->x ? *x1 : clip->x;
+	*y1 = *y1 > clip->y ? *y1 : clip->y;
+	*x2 = *x2 < cx2 ? *x2 : cx2;
+	*y2 = *y2 < cy2 ? *y2 : cy2;
+	*x1 = *x1 > 0 ? *x1 : 0;
+	*y1 = *y1 > 0 ? *y1 : 0;
+	*x2 = *x2 < img->w ? *x2 : img->w;
+	*y2 = *y2 < img->h ? *y2 : img->h;
+	return *x1 < *x2 && *y1 < *y2;
+}
+
+void
+rfill(struct rimage_t *img, const XRectangle *r, uint32_t pixel) {
+	int x1 = r->x, y1 = r->y, x2 = r->x + r->width, y2 = r->y + r->height;
+	if (!rclip(img, r, &x1, &y1, &x2, &y2)) {
+		return;
+	}
+	for (int y = y1; y < y2; ++y) {
+		uint32_t *p = img->px + y * img->stride;
+		for (int x = x1; x < x2; ++x) {
+			p[x] = pixel;
+		}
+	}
+}
+
+void
+rdraw(struct rimage_t *img, const XRectangle *clip, const struct rfont_t *font,
+      const int *idx, int n, int x, int baseline, uint32_t fg) {
+	for (int i = 0; i < n; ++i) {
+		const struct rglyph_t *g = &font->glyph[idx[i]];
+		int gx = x - g->ext.x, gy = baseline - g->ext.y;
+		int x1 = gx, y1 = gy, x2 = gx + g->ext.width, y2 = gy + g->ext.height;
+		x += g->ext.xOff;
+		if (!g->mask || !rclip(img, clip, &x1, &y1, &x2, &y2)) {
+			continue;
+		}
+		for (int y = y1; y < y2; ++y) {
+			const unsigned char *m = g->mask + (y - gy) * g->ext.width - gx;
+			blendspan(img->px + y * img->stride + x1, m + x1, x2 - x1, fg);
+		}
+	}
+}
+
+void
+rfontfree(struct rfont_t *font) {
+	for (int i = 0; i < font->n; ++i) {
+		free(font->glyph[i].mask);
+	}
+	free(font->glyph);
+	font->glyph = NULL;
+	font->n = 0;
+}
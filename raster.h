@@ -0,0 +1,42 @@
+/* Text drawn in software into a client-side buffer of 32-bit pixels.
+ * Glyph coverage is rendered with FreeType once per character, from the
+ * X thread, so that drawing from other threads only reads it. */
+
+#ifndef RASTER_H
+#define RASTER_H
+
+#include <X11/Xft/Xft.h>
+#include <stdint.h>
+
+struct rglyph_t {
+	FcChar32 ucs;
+	/* as Xft measures it; the mask covers the ink box */
+	XGlyphInfo ext;
+	unsigned char *mask;
+};
+
+struct rfont_t {
+	struct rglyph_t *glyph;
+	int n;
+};
+
+struct rimage_t {
+	uint32_t *px;
+	int w, h;
+	/* in pixels */
+	int stride;
+};
+
+/* Look up the glyphs of the UTF-8 string s, rendering those not seen
+ * before, and store their indices in idx. Returns how many, or -1. */
+int rlayout(struct rfont_t *font, Display *dpy, XftFont *xfont, const char *s, int *idx, int max);
+void rfill(struct rimage_t *img, const XRectangle *r, uint32_t pixel);
+/* Blend fg over the image through the glyphs, with the pen at x on the
+ * baseline, inside clip only, with the kernel blendinit chose. Pixels are
+ * blended a byte at a time, so every color channel must be a byte of its
+ * own. */
+void rdraw(struct rimage_t *img, const XRectangle *clip, const struct rfont_t *font,
+           const int *idx, int n, int x, int baseline, uint32_t fg);
+void rfontfree(struct rfont_t *font);
+
+#endif
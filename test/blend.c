@@ -0,0 +1,131 @@
+/* blend.c is included so that every kernel the CPU has can be checked,
+ * not only the one blendinit would choose. */
+#include <math.h>
+#include <stdlib.h>
+
+#include "../blend.c"
+#include "test.h"
+
+#define SPAN 1000
+
+struct kernel {
+	const char *name;
+	kernel_t fn;
+};
+
+/* Each byte of b with f over it at coverage a, rounded to nearest. */
+static uint32_t
+reference(uint32_t b, uint32_t f, unsigned a) {
+	uint32_t out = 0;
+	for (int shift = 0; shift < 32; shift += 8) {
+		unsigned x = (f >> shift & 0xff) * a + (b >> shift & 0xff) * (255 - a);
+		out |= (uint32_t)((x + 127) / 255) << shift;
+	}
+	return out;
+}
+
+/* Every background, color and coverage byte, each channel differing. */
+static void
+testall(const struct kernel *k) {
+	static uint32_t p[256 * 256];
+	static unsigned char m[256 * 256];
+	int bad = 0;
+	for (unsigned f = 0; f < 256; ++f) {
+		uint32_t fg = f | (255 - f) << 8 | (f ^ 0x5a) << 16 | (f * 7 & 0xff) << 24;
+		for (int i = 0; i < 256 * 256; ++i) {
+			unsigned b = i >> 8;
+			p[i] = b | (b ^ 0xff) << 8 | (b * 3 & 0xff) << 16 | (b ^ 0x33) << 24;
+			m[i] = i & 0xff;
+		}
+		k->fn(p, m, 256 * 256, fg);
+		for (int i = 0; i < 256 * 256; ++i) {
+			unsigned b = i >> 8;
+			uint32_t bg = b | (b ^ 0xff) << 8 | (b * 3 & 0xff) << 16 | (b ^ 0x33) << 24;
+			bad += p[i] != reference(bg, fg, m[i]);
+		}
+	}
+	if (bad) {
+		fprintf(stderr, "%s: %d pixels differ\n", k->name, bad);
+	}
+	check(!bad);
+}
+
+/* Spans of every length and alignment, with runs of empty and full
+ * coverage, leaving the pixels around them alone. */
+static void
+testspans(const struct kernel *k) {
+	static uint32_t p[SPAN + 16], q[SPAN + 16];
+	static unsigned char m[SPAN + 16];
+	int bad = 0;
+	srand(1);
+	for (int it = 0; it < 5000; ++it) {
+		int off = rand() % 8, n = rand() % (it < 100 ? 40 : SPAN);
+		uint32_t fg = (uint32_t)rand() << 1 ^ (uint32_t)rand();
+		int run = rand() % 3;
+		for (int i = 0; i < SPAN + 16; ++i) {
+			q[i] = p[i] = (uint32_t)rand() << 1 ^ (uint32_t)rand();
+			m[i] = run == 0 ? rand() : rand() % 2 ? 0 : 255;
+			if (run == 2 && rand() % 4 == 0) {
+				m[i] = rand();
+			}
+		}
+		for (int i = off; i < off + n; ++i) {
+			q[i] = reference(q[i], fg, m[i]);
+		}
+		k->fn(p + off, m + off, n, fg);
+		for (int i = 0; i < SPAN + 16; ++i) {
+			bad += p[i] != q[i];
+		}
+	}
+	if (bad) {
+		fprintf(stderr, "%s: %d pixels differ in spans\n", k->name, bad);
+	}
+	check(!bad);
+}
+
+/* Through linear light, to within the 12 bits of the tables. */
+static void
+testgamma() {
+	uint32_t p[256];
+	unsigned char m[256];
+	int bad = 0;
+	blendinit(2.2);
+	check(!strcmp(blendname(), "scalar, gamma"));
+	for (unsigned b = 0; b < 256; b += 15) {
+		for (int a = 0; a < 256; ++a) {
+			p[a] = b * 0x01010101u;
+			m[a] = a;
+		}
+		blendspan(p, m, 256, 0xffffffff);
+		for (int a = 0; a < 256; ++a) {
+			double l = a / 255.0 + pow(b / 255.0, 2.2) * (255 - a) / 255.0;
+			double want = pow(l, 1 / 2.2) * 255;
+			bad += fabs((double)(p[a] & 0xff) - want) > 1.5;
+			bad += a == 0 && p[a] != b * 0x01010101u;
+			bad += a == 255 && p[a] != 0xffffffff;
+		}
+	}
+	check(!bad);
+}
+
+int
+main() {
+	struct kernel kernels[3] = { { "scalar", scalar } };
+	int n = 1;
+#ifdef BLEND_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse2")) {
+		kernels[n++] = (struct kernel){ "sse2", sse2 };
+	}
+	if (__builtin_cpu_supports("avx2")) {
+		kernels[n++] = (struct kernel){ "avx2", avx2 };
+	}
+#endif
+	for (int i = 0; i < n; ++i) {
+		testall(&kernels[i]);
+		testspans(&kernels[i]);
+		printf("blend: %s checked\n", kernels[i].name);
+	}
+	testgamma();
+	return done("blend");
+}
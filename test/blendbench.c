@@ -0,0 +1,52 @@
+/* Throughput of each blending kernel the CPU has, over a span the size
+ * of a large glyph. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../blend.c"
+
+#define SPAN (1 << 20)
+#define REPEAT 200
+
+static void
+bench(const char *name, kernel_t fn, const char *maskname, const unsigned char *m, uint32_t *p) {
+	struct timespec t0, t1;
+	double s;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (int r = 0; r < REPEAT; ++r) {
+		fn(p, m, SPAN, 0x00202020 + r);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	s = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+	printf("%-14s %-8s %6.0f Mpixels/s\n", name, maskname, (double)SPAN * REPEAT / s / 1e6);
+}
+
+int
+main() {
+	static uint32_t p[SPAN];
+	static unsigned char glyph[SPAN], edges[SPAN];
+	/* a glyph is mostly empty or full, with partial coverage at the edges */
+	for (int i = 0; i < SPAN; ++i) {
+		glyph[i] = i % 37 < 10 ? 0 : i % 37 < 25 ? 255 : i * 7;
+		edges[i] = i * 13 | 1;
+		p[i] = 0x00101010;
+	}
+	blendinit(2.2);
+	bench(blendname(), linear, "glyph", glyph, p);
+	bench(blendname(), linear, "edges", edges, p);
+	bench("scalar", scalar, "glyph", glyph, p);
+	bench("scalar", scalar, "edges", edges, p);
+#ifdef BLEND_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse2")) {
+		bench("sse2", sse2, "glyph", glyph, p);
+		bench("sse2", sse2, "edges", edges, p);
+	}
+	if (__builtin_cpu_supports("avx2")) {
+		bench("avx2", avx2, "glyph", glyph, p);
+		bench("avx2", avx2, "edges", edges, p);
+	}
+#endif
+	return 0;
+}
@@ -0,0 +1,81 @@
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <signal.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "evloop.h"
+#include "test.h"
+
+static int calls, lastfd, lastsig;
+static unsigned lastevents;
+
+static void
+oncall(int fd, unsigned events, void *arg) {
+	char c;
+	++calls;
+	++*(int*)arg;
+	lastfd = fd;
+	lastevents = events;
+	if (read(fd, &c, 1) < 0) {
+		check(0);
+	}
+}
+
+static void
+onsignal(int signo, void *arg) {
+	++*(int*)arg;
+	lastsig = signo;
+}
+
+int
+main() {
+	int fds[2], tfd, sigs[] = { SIGUSR1 };
+	int pipecalls = 0, sigcalls = 0;
+	uint64_t expirations;
+	struct itimerspec its = { .it_value = { 0, 1000000 } };
+
+	check(evinit() == 0);
+	check(pipe(fds) == 0);
+
+	/* nothing ready: the timeout expires with nothing dispatched */
+	check(evadd(fds[0], EPOLLIN, oncall, &pipecalls) == 0);
+	check(evwait(0) == 0);
+	check(calls == 0);
+
+	/* a readable pipe calls its callback with its fd and argument */
+	check(write(fds[1], "x", 1) == 1);
+	check(evwait(-1) == 1);
+	check(calls == 1 && pipecalls == 1);
+	check(lastfd == fds[0] && (lastevents & EPOLLIN));
+	check(evwait(0) == 0);
+
+	/* after evdel, the pipe no longer wakes the loop */
+	check(evdel(fds[0]) == 0);
+	check(evdel(fds[0]) < 0);
+	check(write(fds[1], "y", 1) == 1);
+	check(evwait(0) == 0);
+	check(pipecalls == 1);
+
+	/* a NULL callback only wakes the loop; the timerfd stays readable */
+	check((tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK)) >= 0);
+	check(evadd(tfd, EPOLLIN, NULL, NULL) == 0);
+	check(timerfd_settime(tfd, 0, &its, NULL) == 0);
+	check(evwait(1000) == 1);
+	check(calls == 1);
+	check(read(tfd, &expirations, sizeof(expirations)) == sizeof(expirations) && expirations == 1);
+	check(evdel(tfd) == 0);
+
+	/* a raised signal is delivered to its callback, not to a handler */
+	check(evsignal(sigs, 1, onsignal, &sigcalls) == 0);
+	check(raise(SIGUSR1) == 0);
+	check(evwait(1000) == 1);
+	check(sigcalls == 1 && lastsig == SIGUSR1);
+	check(evwait(0) == 0);
+
+	evcleanup();
+	close(tfd);
+	close(fds[0]);
+	close(fds[1]);
+	return done("evloop");
+}
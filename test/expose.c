@@ -0,0 +1,43 @@
+/* A burst of exposures is drained and redrawn once, after which wallclock
+ * goes back to sleep instead of spinning on the connection. */
+#include "test.h"
+#include "xvfb.h"
+
+#define EXPOSES 1000
+
+int
+main() {
+	Display *dpy = startxvfb("1280x800x24");
+	if (!dpy) {
+		printf("expose: skipped, no Xvfb\n");
+		return 0;
+	}
+	const char *args[] = { NULL };
+	check(startwallclock(dpy, args, NULL));
+
+	Window root = DefaultRootWindow(dpy);
+	for (int i = 0; i < EXPOSES; ++i) {
+		XEvent ev = { 0 };
+		ev.xexpose.type = Expose;
+		ev.xexpose.window = root;
+		ev.xexpose.x = i % 1280;
+		ev.xexpose.y = i % 800;
+		ev.xexpose.width = 64;
+		ev.xexpose.height = 64;
+		ev.xexpose.count = EXPOSES - 1 - i;
+		XSendEvent(dpy, root, False, ExposureMask, &ev);
+	}
+	XSync(dpy, False);
+	msleep(200);
+
+	long before = cputicks(wallclockpid);
+	msleep(3000);
+	long after = cputicks(wallclockpid);
+	check(before >= 0 && after >= 0);
+	/* a loop polling the connection would take all of the 3s */
+	check(after - before < sysconf(_SC_CLK_TCK) / 10);
+	check(alive());
+
+	XCloseDisplay(dpy);
+	return done("expose");
+}
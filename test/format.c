@@ -0,0 +1,110 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "format.h"
+#include "test.h"
+
+/* Every conversion fmtcompile handles itself, and some it leaves to
+ * strftime, with flags, widths and literals around them. */
+static const char *formats[] = {
+	"%H:%M",
+	"%Y-%m-%d %a. v. %V",
+	"%H:%M:%S",
+	"%k %l %I %p %P",
+	"%e %d %m %y %C %Y %j %w %u",
+	"%a %A %b %B %h",
+	"%R %T %r %X",
+	"%D %F %x",
+	"%G %g %V %U %W",
+	"%z %Z",
+	"%_H %-M %010S %^a %#b %EY %Od",
+	"%% %n %t literal",
+	"",
+};
+
+/* Render t in each format, as a clock does, and compare with strftime.
+ * A render that reports no change must have left the previous string,
+ * which must still be right. */
+static int
+compare(struct fmt_t *fmt, char (*bufs)[FMT_OUTSZ], int n, time_t t) {
+	char want[FMT_OUTSZ];
+	struct tm tm;
+	int bad = 0;
+	localtime_r(&t, &tm);
+	for (int i = 0; i < n; ++i) {
+		fmtrender(&fmt[i], &tm, 0, bufs[i], FMT_OUTSZ);
+		strftime(want, sizeof(want), formats[i], &tm);
+		if (strcmp(bufs[i], want) && bad++ < 10) {
+			fprintf(stderr, "%s at %lld: got \"%s\", want \"%s\"\n",
+			        formats[i], (long long)t, bufs[i], want);
+		}
+	}
+	return bad;
+}
+
+/* A year of minutes in a zone with daylight saving time, and every
+ * second of the days the clocks change. */
+static void
+testyear() {
+	enum { N = sizeof(formats) / sizeof(formats[0]) };
+	struct fmt_t fmt[N];
+	char bufs[N][FMT_OUTSZ] = { { 0 } };
+	time_t t0 = 1704067200; /* 2024, a leap year */
+	time_t dst[] = { 1711846800, 1729990800 };
+	int bad = 0;
+
+	setenv("TZ", "Europe/Stockholm", 1);
+	tzset();
+	for (int i = 0; i < N; ++i) {
+		check(fmtcompile(&fmt[i], formats[i]));
+	}
+	for (time_t t = t0; t < t0 + 366 * 86400; t += 60) {
+		bad += compare(fmt, bufs, N, t);
+	}
+	for (int j = 0; j < 2; ++j) {
+		for (time_t t = dst[j] - 43200; t < dst[j] + 43200; ++t) {
+			bad += compare(fmt, bufs, N, t);
+		}
+	}
+	for (int i = 0; i < N; ++i) {
+		fmtfree(&fmt[i]);
+	}
+	check(!bad);
+}
+
+/* %N and its widths truncate the nanoseconds, as date(1) does. */
+static void
+testfrac() {
+	struct fmt_t fmt;
+	struct tm tm = { .tm_sec = 5 };
+	char buf[FMT_OUTSZ];
+
+	check(fmtcompile(&fmt, "%S.%N"));
+	check(fmt.digits == 9 && (fmt.deps & TM_FRAC));
+	check(fmtrender(&fmt, &tm, 123456789, buf, sizeof(buf)) && !strcmp(buf, "05.123456789"));
+	check(!fmtrender(&fmt, &tm, 123456789, buf, sizeof(buf)));
+	check(fmtrender(&fmt, &tm, 7, buf, sizeof(buf)) && !strcmp(buf, "05.000000007"));
+	fmtfree(&fmt);
+
+	check(fmtcompile(&fmt, "%3N"));
+	check(fmt.digits == 3);
+	check(fmtrender(&fmt, &tm, 999999999, buf, sizeof(buf)) && !strcmp(buf, "999"));
+	/* the same milliseconds are not a change */
+	check(!fmtrender(&fmt, &tm, 999000000, buf, sizeof(buf)));
+	check(fmtrender(&fmt, &tm, 1000000, buf, sizeof(buf)) && !strcmp(buf, "001"));
+	fmtfree(&fmt);
+
+	check(fmtcompile(&fmt, "%H:%M"));
+	check(fmt.digits == 0 && !(fmt.deps & TM_FRAC));
+	check(fmtrender(&fmt, &tm, 1, buf, sizeof(buf)));
+	check(!fmtrender(&fmt, &tm, 2, buf, sizeof(buf)));
+	fmtfree(&fmt);
+}
+
+int
+main() {
+	testyear();
+	testfrac();
+	return done("format");
+}
@@ -0,0 +1,77 @@
+/* The compiled default formats against strftime over a year of
+ * one-second ticks, strftime being followed by the strcmp that a clock
+ * needs to know whether to redraw. */
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "format.h"
+
+#define TICKS 31536000
+
+static const char *formats[] = { "%H:%M", "%Y-%m-%d %a. v. %V" };
+
+static double
+seconds(const struct timespec *a, const struct timespec *b) {
+	return (b->tv_sec - a->tv_sec) + (b->tv_nsec - a->tv_nsec) / 1e9;
+}
+
+/* The same ticks with nothing done for them, to subtract. */
+static double
+baseline(time_t t0) {
+	struct timespec a, b;
+	struct tm tm;
+	volatile int sink = 0;
+	clock_gettime(CLOCK_MONOTONIC, &a);
+	for (time_t t = t0; t < t0 + TICKS; ++t) {
+		gmtime_r(&t, &tm);
+		sink += tm.tm_sec;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &b);
+	return seconds(&a, &b);
+}
+
+int
+main() {
+	const time_t t0 = 1704067200;
+	double base = baseline(t0);
+
+	for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); ++i) {
+		char buf[FMT_OUTSZ] = "", prev[FMT_OUTSZ] = "";
+		unsigned long redraws[2] = { 0, 0 };
+		struct timespec a, b;
+		struct fmt_t fmt;
+		struct tm tm;
+		double compiled, libc;
+
+		if (!fmtcompile(&fmt, formats[i])) {
+			fprintf(stderr, "cannot compile %s\n", formats[i]);
+			return 1;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &a);
+		for (time_t t = t0; t < t0 + TICKS; ++t) {
+			gmtime_r(&t, &tm);
+			redraws[0] += fmtrender(&fmt, &tm, 0, buf, sizeof(buf));
+		}
+		clock_gettime(CLOCK_MONOTONIC, &b);
+		compiled = seconds(&a, &b) - base;
+
+		clock_gettime(CLOCK_MONOTONIC, &a);
+		for (time_t t = t0; t < t0 + TICKS; ++t) {
+			gmtime_r(&t, &tm);
+			strftime(buf, sizeof(buf), formats[i], &tm);
+			if (strcmp(buf, prev)) {
+				strcpy(prev, buf);
+				++redraws[1];
+			}
+		}
+		clock_gettime(CLOCK_MONOTONIC, &b);
+		libc = seconds(&a, &b) - base;
+
+		printf("%-20s fmtrender %5.1fns/tick, strftime+strcmp %5.1fns/tick, %.1fx (%lu and %lu redraws)\n",
+		       formats[i], compiled * 1e9 / TICKS, libc * 1e9 / TICKS, libc / compiled,
+		       redraws[0], redraws[1]);
+		fmtfree(&fmt);
+	}
+	return 0;
+}
@@ -0,0 +1,71 @@
+/* Updates draw through the XftDraws made at startup, so however many
+ * there are, wallclock owns the same number of RENDER Pictures. */
+#include <X11/extensions/XRes.h>
+
+#include "test.h"
+#include "xvfb.h"
+
+/* Pictures owned by the one client other than us, or -1. */
+static int
+pictures(Display *dpy) {
+	XResClient *clients;
+	XResType *types;
+	XID base = XAllocID(dpy), id = None;
+	int n, ntypes, count = 0;
+	Atom picture = XInternAtom(dpy, "PICTURE", False);
+
+	if (!XResQueryClients(dpy, &n, &clients)) {
+		return -1;
+	}
+	for (int i = 0; i < n; ++i) {
+		if ((base & ~clients[i].resource_mask) != clients[i].resource_base) {
+			id = clients[i].resource_base;
+		}
+	}
+	XFree(clients);
+	if (id == None || !XResQueryClientResources(dpy, id, &ntypes, &types)) {
+		return -1;
+	}
+	for (int i = 0; i < ntypes; ++i) {
+		if (types[i].resource_type == picture) {
+			count = types[i].count;
+		}
+	}
+	XFree(types);
+	return count;
+}
+
+static void
+testupdates(Display *dpy, const char *const *args) {
+	check(startwallclock(dpy, args, NULL));
+	/* the first updates fill the caches of solid colors and glyphs */
+	msleep(1000);
+	int before = pictures(dpy);
+	/* tenths of a second: thirty updates */
+	msleep(3000);
+	int after = pictures(dpy);
+	check(before > 0);
+	check(after == before);
+	check(alive());
+	stop(&wallclockpid);
+	msleep(200);
+}
+
+int
+main() {
+	Display *dpy = startxvfb("1280x800x24");
+	int evbase, errbase;
+	if (!dpy) {
+		printf("pictures: skipped, no Xvfb\n");
+		return 0;
+	}
+	check(XResQueryExtension(dpy, &evbase, &errbase));
+
+	const char *xft[] = { "-D", "%T.%1N", NULL };
+	testupdates(dpy, xft);
+	const char *atlas[] = { "-A", "-D", "%T.%1N", NULL };
+	testupdates(dpy, atlas);
+
+	XCloseDisplay(dpy);
+	return done("pictures");
+}
@@ -0,0 +1,121 @@
+/* Changes of resolution under a running wallclock: each one is laid out
+ * again, heads that keep their size keep their pixmaps, and the process
+ * lives on.  Prints how long the relayouts took. */
+#include <X11/extensions/Xrandr.h>
+
+#include "test.h"
+#include "xvfb.h"
+
+static bool xerror;
+
+static int
+onerror(Display *dpy, XErrorEvent *ev) {
+	xerror = true;
+	return 0;
+}
+
+static struct {
+	int count;
+	int changed;
+	int maxus;
+} relayouts;
+
+/* Take in the relayouts reported until out has been quiet for a while. */
+static void
+readrelayouts(int out) {
+	char line[256];
+	int heads, kept, us;
+	relayouts.count = relayouts.changed = 0;
+	while (readline(out, line, sizeof(line), 2000)) {
+		if (sscanf(line, "relayout: %d heads, %d kept their pixmaps, %dus", &heads, &kept, &us) == 3) {
+			++relayouts.count;
+			relayouts.changed += heads - kept;
+			relayouts.maxus = us > relayouts.maxus ? us : relayouts.maxus;
+		}
+	}
+}
+
+/* Set the one output to a mode of w by h and the screen to its size,
+ * as xrandr --output --mode --fb would.  False if the server says no. */
+static bool
+resize(Display *dpy, unsigned int w, unsigned int h) {
+	Window root = DefaultRootWindow(dpy);
+	XRRScreenResources *res = XRRGetScreenResourcesCurrent(dpy, root);
+	XRROutputInfo *info = NULL;
+	char name[32];
+	bool ok = false;
+
+	if (res && res->noutput > 0 && (info = XRRGetOutputInfo(dpy, res, res->outputs[0])) && info->crtc) {
+		/* a name of its own, as the server refuses to redefine one */
+		snprintf(name, sizeof(name), "test-%ux%u", w, h);
+		XRRModeInfo mode = {
+			.width = w, .height = h, .dotClock = w * h * 60UL,
+			.hSyncStart = w, .hSyncEnd = w, .hTotal = w,
+			.vSyncStart = h, .vSyncEnd = h, .vTotal = h,
+			.name = name, .nameLength = strlen(name),
+		};
+		RRMode id = XRRCreateMode(dpy, root, &mode);
+		XRRAddOutputMode(dpy, res->outputs[0], id);
+		XRRSetCrtcConfig(dpy, res, info->crtc, CurrentTime, 0, 0, id, RR_Rotate_0, res->outputs, 1);
+		XRRSetScreenSize(dpy, root, w, h, w * 254 / 960, h * 254 / 960);
+		xerror = false;
+		XSync(dpy, False);
+		ok = !xerror;
+	}
+	if (info) {
+		XRRFreeOutputInfo(info);
+	}
+	if (res) {
+		XRRFreeScreenResources(res);
+	}
+	return ok;
+}
+
+int
+main() {
+	Display *dpy = startxvfb("1280x800x24");
+	int evbase, errbase, out;
+	if (!dpy) {
+		printf("relayout: skipped, no Xvfb\n");
+		return 0;
+	}
+	check(XRRQueryExtension(dpy, &evbase, &errbase));
+	XSetErrorHandler(onerror);
+
+	const char *args[] = { "-v", "-v", NULL };
+	check(startwallclock(dpy, args, &out));
+	readrelayouts(out);
+
+	if (!resize(dpy, 1024, 768)) {
+		printf("relayout: skipped, Xvfb cannot change resolution\n");
+		return 0;
+	}
+	readrelayouts(out);
+	check(relayouts.count > 0);
+	check(relayouts.changed > 0);
+	check(alive());
+
+	/* a new primary output changes nothing on screen */
+	Window root = DefaultRootWindow(dpy);
+	XRRScreenResources *res = XRRGetScreenResourcesCurrent(dpy, root);
+	RROutput output = res->outputs[0];
+	XRRFreeScreenResources(res);
+	XRRSetOutputPrimary(dpy, root, XRRGetOutputPrimary(dpy, root) == output ? None : output);
+	XSync(dpy, False);
+	readrelayouts(out);
+	check(relayouts.count > 0);
+	check(relayouts.changed == 0);
+	check(alive());
+
+	if (!resize(dpy, 1280, 800)) {
+		check(!"could not change back");
+	}
+	readrelayouts(out);
+	check(relayouts.count > 0);
+	check(relayouts.changed > 0);
+	check(alive());
+
+	printf("relayout: %dus at most\n", relayouts.maxus);
+	XCloseDisplay(dpy);
+	return done("relayout");
+}
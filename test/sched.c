@@ -0,0 +1,157 @@
+/* Scheduling of updates against a clock the test steps, as settimeofday,
+ * an NTP step or a resume would. */
+#include <errno.h>
+#include <stdlib.h>
+
+#include "timer.h"
+#include "tz.h"
+#include "test.h"
+
+static struct {
+	struct timespec now;
+	struct timespec armed;
+	bool set;
+} clk;
+
+static struct {
+	int calls;
+	struct timespec at;
+	bool ontime;
+} updates;
+
+static void
+fakenow(struct timespec *ts) {
+	*ts = clk.now;
+}
+
+static int
+fakearm(int fd, const struct timespec *at) {
+	clk.armed = *at;
+	return 0;
+}
+
+static ssize_t
+fakeread(int fd, uint64_t *expirations) {
+	if (clk.set) {
+		clk.set = false;
+		errno = ECANCELED;
+		return -1;
+	}
+	if (clk.now.tv_sec < clk.armed.tv_sec
+	 || (clk.now.tv_sec == clk.armed.tv_sec && clk.now.tv_nsec < clk.armed.tv_nsec)) {
+		errno = EAGAIN;
+		return -1;
+	}
+	*expirations = 1;
+	return sizeof(*expirations);
+}
+
+static const struct timerops_t fakeops = { fakenow, fakearm, fakeread };
+
+static void
+update(const struct timespec *now, bool ontime, void *arg) {
+	++updates.calls;
+	updates.at = *now;
+	updates.ontime = ontime;
+}
+
+static bool
+eq(const struct timespec *ts, time_t sec, long nsec) {
+	return ts->tv_sec == sec && ts->tv_nsec == nsec;
+}
+
+/* Setting the clock, which the kernel reports by cancelling the timer. */
+static void
+step(time_t sec, long nsec) {
+	clk.now = (struct timespec){ sec, nsec };
+	clk.set = true;
+}
+
+/* Once a minute, with the clock stepped forward and back. */
+static void
+testminutes() {
+	const time_t noon = 1718625600; /* 2024-06-17 12:00:00 UTC */
+
+	updates.calls = 0;
+	check(timerinit(&fakeops, UNIT_MINUTE, 1, 0) >= 0);
+	clk.now = (struct timespec){ noon + 30, 500000000 };
+	check(timerarm(&clk.now) == 0);
+	check(eq(timernext(), noon + 60, 0) && eq(&clk.armed, noon + 60, 0));
+
+	/* on time */
+	clk.now = (struct timespec){ noon + 60, 1000 };
+	check(timerhandle(update, NULL) == TIMER_DUE);
+	check(updates.calls == 1 && updates.ontime && eq(&updates.at, noon + 60, 1000));
+	check(eq(&clk.armed, noon + 120, 0));
+
+	/* forward: redrawn at once for the new time, not at the old boundary */
+	step(noon + 3600 + 10, 0);
+	check(timerhandle(update, NULL) == TIMER_SET);
+	check(updates.calls == 2 && !updates.ontime && eq(&updates.at, noon + 3610, 0));
+	check(eq(timernext(), noon + 3660, 0) && eq(&clk.armed, noon + 3660, 0));
+
+	/* back: the same, and the timer is no longer an hour away */
+	step(noon - 600 + 20, 0);
+	check(timerhandle(update, NULL) == TIMER_SET);
+	check(updates.calls == 3 && !updates.ontime && eq(&updates.at, noon - 580, 0));
+	check(eq(&clk.armed, noon - 540, 0));
+
+	/* due after a wait with a timeout, before the timer fires */
+	clk.now = (struct timespec){ noon - 560, 0 };
+	check(timerdue(update, NULL) == 0 && updates.calls == 3);
+	clk.now = (struct timespec){ noon - 540, 2000 };
+	check(timerdue(update, NULL) == 1 && updates.calls == 4 && updates.ontime);
+	check(eq(&clk.armed, noon - 480, 0));
+	timercleanup();
+}
+
+/* Fractions of a second, evenly spaced from the whole second, and the
+ * offset of the timer from the update. */
+static void
+testframes() {
+	struct timespec ts;
+
+	check(timerinit(&fakeops, UNIT_SECOND, 30, -10000000) >= 0);
+	ts = timerframe(&(struct timespec){ 100, 0 });
+	check(eq(&ts, 100, 33333334));
+	ts = timerframe(&(struct timespec){ 100, 33333334 });
+	check(eq(&ts, 100, 66666667));
+	ts = timerframe(&(struct timespec){ 100, 990000000 });
+	check(eq(&ts, 101, 0));
+
+	clk.now = (struct timespec){ 100, 980000000 };
+	check(timerarm(&clk.now) == 0);
+	check(eq(timernext(), 101, 0) && eq(&clk.armed, 100, 990000000));
+
+	/* stepped back within the second */
+	step(100, 500000000);
+	updates.calls = 0;
+	check(timerhandle(update, NULL) == TIMER_SET && updates.calls == 1);
+	check(eq(timernext(), 100, 533333334));
+	timercleanup();
+}
+
+/* A day's display changes at midnight, and when the offset changes. */
+static void
+testzone() {
+	setenv("TZ", "Europe/Stockholm", 1);
+	tzinit();
+	/* 2024-03-31 00:30 UTC, half an hour before summer time */
+	check(timerboundary(1711845000, UNIT_DAY) == 1711846800);
+	/* 2024-06-17 12:00 UTC; midnight local is 22:00 UTC */
+	check(timerboundary(1718625600, UNIT_DAY) == 1718661600);
+	check(timerboundary(1718625600, UNIT_HOUR) == 1718629200);
+	check(timerboundary(1718625600, UNIT_SECOND) == 1718625601);
+	tzcleanup();
+}
+
+int
+main() {
+	setenv("TZ", "UTC", 1);
+	tzinit();
+	testminutes();
+	testframes();
+	tzcleanup();
+	testzone();
+	return done("sched");
+}
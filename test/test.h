@@ -0,0 +1,25 @@
+/* Checks for the tests under test/, which are plain programs that print
+ * what failed and exit non-zero if anything did. */
+
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+
+static int failures;
+
+#define check(cond) do { \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		++failures; \
+	} \
+} while (0)
+
+/* Report and give the exit status. */
+static int
+done(const char *name) {
+	printf("%s: %s\n", name, failures ? "FAIL" : "ok");
+	return failures != 0;
+}
+
+#endif
@@ -0,0 +1,163 @@
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tz.h"
+#include "test.h"
+
+#define ZONEDIR "/usr/share/zoneinfo"
+
+static bool
+copy(const char *from, const char *to) {
+	char buf[4096];
+	ssize_t n;
+	int in, out;
+	bool ok = true;
+	if ((in = open(from, O_RDONLY)) < 0) {
+		return false;
+	}
+	if ((out = open(to, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+		close(in);
+		return false;
+	}
+	while ((n = read(in, buf, sizeof(buf))) > 0) {
+		ok &= write(out, buf, n) == n;
+	}
+	close(in);
+	return !close(out) && ok && !n;
+}
+
+/* Handle events until there have been none for a while, and return how
+ * many reloads they caused. A loop that keeps reloading stops at 100. */
+static int
+reloads(int fd) {
+	struct pollfd p = { .fd = fd, .events = POLLIN };
+	int n = 0;
+	for (int i = 0; i < 100 && poll(&p, 1, 200) > 0; ++i) {
+		n += tzhandle();
+	}
+	return n;
+}
+
+/* Replacing the zone file the way package managers do, by renaming a new
+ * file over it, is one reload, and after it the new zone is in use. */
+static void
+testreload() {
+	char dir[] = "/tmp/tztest.XXXXXX", zone[PATH_MAX], tmp[PATH_MAX];
+	struct tm tm;
+	int fd;
+
+	if (!mkdtemp(dir)) {
+		check(!"mkdtemp");
+		return;
+	}
+	snprintf(zone, sizeof(zone), "%s/zone", dir);
+	snprintf(tmp, sizeof(tmp), "%s/zone.new", dir);
+	check(copy(ZONEDIR "/UTC", zone));
+	setenv("TZ", zone, 1);
+	check((fd = tzinit()) >= 0);
+	check(reloads(fd) == 0);
+	check(tzlocal(0, &tm) && tm.tm_gmtoff == 0);
+
+	check(copy(ZONEDIR "/Asia/Tokyo", tmp));
+	check(rename(tmp, zone) == 0);
+	check(reloads(fd) == 1);
+	check(tzlocal(0, &tm) && tm.tm_gmtoff == 9 * 3600);
+
+	check(copy(ZONEDIR "/UTC", tmp));
+	check(rename(tmp, zone) == 0);
+	check(reloads(fd) == 1);
+	check(tzlocal(0, &tm) && tm.tm_gmtoff == 0);
+
+	/* starting over watches the same directory again */
+	tzcleanup();
+	check((fd = tzinit()) >= 0);
+	check(copy(ZONEDIR "/Asia/Tokyo", tmp));
+	check(rename(tmp, zone) == 0);
+	check(reloads(fd) == 1);
+	check(tzlocal(0, &tm) && tm.tm_gmtoff == 9 * 3600);
+
+	tzcleanup();
+	unlink(zone);
+	rmdir(dir);
+}
+
+static bool
+sametm(const struct tm *a, const struct tm *b) {
+	return a->tm_sec == b->tm_sec && a->tm_min == b->tm_min && a->tm_hour == b->tm_hour
+	    && a->tm_mday == b->tm_mday && a->tm_mon == b->tm_mon && a->tm_year == b->tm_year
+	    && a->tm_wday == b->tm_wday && a->tm_yday == b->tm_yday && a->tm_isdst == b->tm_isdst
+	    && a->tm_gmtoff == b->tm_gmtoff && !strcmp(a->tm_zone, b->tm_zone);
+}
+
+static int
+compare(const char *zone, time_t t) {
+	struct tm got, want;
+	if (!tzlocal(t, &got) || !localtime_r(&t, &want) || !sametm(&got, &want)) {
+		fprintf(stderr, "%s at %lld: got %02d:%02d %s, want %02d:%02d %s\n", zone, (long long)t,
+		        got.tm_hour, got.tm_min, got.tm_zone, want.tm_hour, want.tm_min, want.tm_zone);
+		return 1;
+	}
+	return 0;
+}
+
+/* Local time from the table against glibc, sampled between from and
+ * 2100 and at both sides of every change that tznext gives, with the
+ * offset never changing before the instant tznext returns. */
+static void
+sweep(const char *zone, time_t from) {
+	const time_t to = 4102444800;
+	struct tm a, b;
+	int bad = 0;
+
+	setenv("TZ", zone, 1);
+	tzset();
+	tzinit();
+	for (time_t t = from; t < to && bad < 10; t += 21601) {
+		bad += compare(zone, t);
+	}
+	for (time_t t = from, n; t < to && bad < 10 && (n = tznext(t)) > 0; t = n) {
+		bad += compare(zone, n - 1) + compare(zone, n);
+		if (tzlocal(t, &a) && tzlocal(n - 1, &b)
+		 && (a.tm_gmtoff != b.tm_gmtoff || a.tm_isdst != b.tm_isdst || strcmp(a.tm_zone, b.tm_zone))) {
+			fprintf(stderr, "%s: changes between %lld and tznext %lld\n", zone, (long long)t, (long long)n);
+			++bad;
+		}
+		check(n > t);
+	}
+	tzcleanup();
+	check(!bad);
+}
+
+int
+main() {
+	/* 1900, and 1970 for rules alone, which glibc does not apply before */
+	const time_t y1900 = -2208988800, y1970 = 0;
+	const char *zones[] = {
+		"UTC", "Europe/Stockholm", "Europe/Dublin", "America/New_York",
+		"America/St_Johns", "America/Sao_Paulo", "Africa/Casablanca",
+		"Asia/Kolkata", "Australia/Lord_Howe", "Pacific/Chatham",
+		"Pacific/Kiritimati", "Antarctica/Troll",
+	};
+	const char *rules[] = {
+		"EST5EDT,M3.2.0,M11.1.0",
+		"<-03>3<-02>,M3.5.0/-2,M10.5.0/-1",
+		"IST-1GMT0,M10.5.0,M3.5.0/1",
+		"AAA-10BBB,J60/26,J300/-3",
+		"<+1030>-10:30<+11>-11,M10.1.0,M4.1.0",
+	};
+	for (size_t i = 0; i < sizeof(zones) / sizeof(zones[0]); ++i) {
+		sweep(zones[i], y1900);
+	}
+	for (size_t i = 0; i < sizeof(rules) / sizeof(rules[0]); ++i) {
+		sweep(rules[i], y1970);
+	}
+	testreload();
+	return done("tz");
+}
@@ -0,0 +1,172 @@
+/* For the tests that need an X server: each starts an Xvfb of its own
+ * and ./wallclock against it, and both are killed when the test exits.
+ * Without Xvfb the test has nothing to run on and passes. */
+
+#ifndef XVFB_H
+#define XVFB_H
+
+#include <X11/Xlib.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+static pid_t xvfbpid = -1, wallclockpid = -1;
+
+static void
+msleep(long ms) {
+	struct timespec ts = { ms / 1000, ms % 1000 * 1000000 };
+	while (nanosleep(&ts, &ts) < 0) {
+	}
+}
+
+static void
+stop(pid_t *pid) {
+	if (*pid > 0) {
+		kill(*pid, SIGTERM);
+		waitpid(*pid, NULL, 0);
+		*pid = -1;
+	}
+}
+
+static void
+stopall(void) {
+	stop(&wallclockpid);
+	stop(&xvfbpid);
+}
+
+/* Read a line from fd into buf, giving up after ms.  Reads a byte at a
+ * time, so nothing past the line is taken from the pipe. */
+static bool
+readline(int fd, char *buf, size_t size, long ms) {
+	struct pollfd pfd = { fd, POLLIN, 0 };
+	size_t n = 0;
+	while (n + 1 < size) {
+		if (poll(&pfd, 1, ms) <= 0 || read(fd, buf + n, 1) != 1) {
+			break;
+		}
+		if (buf[n++] == '\n') {
+			buf[n] = '\0';
+			return true;
+		}
+	}
+	buf[n] = '\0';
+	return false;
+}
+
+/* Start Xvfb with one screen of the given geometry, like 1280x800x24,
+ * and connect to it.  NULL if there is no Xvfb. */
+static Display *
+startxvfb(const char *geometry) {
+	int fds[2], null;
+	char fd[16], num[16], display[24];
+
+	if (pipe(fds) < 0 || (xvfbpid = fork()) < 0) {
+		return NULL;
+	}
+	if (!xvfbpid) {
+		close(fds[0]);
+		if ((null = open("/dev/null", O_WRONLY)) >= 0) {
+			dup2(null, STDOUT_FILENO);
+			dup2(null, STDERR_FILENO);
+		}
+		snprintf(fd, sizeof(fd), "%d", fds[1]);
+		execlp("Xvfb", "Xvfb", "-displayfd", fd, "-screen", "0", geometry,
+		       "-nolisten", "tcp", (char*)NULL);
+		_exit(127);
+	}
+	atexit(stopall);
+	close(fds[1]);
+	/* the display number comes once the server accepts clients */
+	bool ready = readline(fds[0], num, sizeof(num), 10000);
+	close(fds[0]);
+	if (!ready) {
+		stop(&xvfbpid);
+		return NULL;
+	}
+	snprintf(display, sizeof(display), ":%d", atoi(num));
+	setenv("DISPLAY", display, 1);
+	return XOpenDisplay(NULL);
+}
+
+/* Start ./wallclock in the foreground with the given arguments, its
+ * standard output on *out unless that is NULL, and wait for it to
+ * select exposures on the root window, which it does once set up. */
+static bool
+startwallclock(Display *dpy, const char *const *args, int *out) {
+	const char *argv[16] = { "./wallclock", "-x" };
+	int n = 2, fds[2];
+	XWindowAttributes wa;
+
+	while (*args && n < 15) {
+		argv[n++] = *args++;
+	}
+	argv[n] = NULL;
+	if ((out && pipe(fds) < 0) || (wallclockpid = fork()) < 0) {
+		return false;
+	}
+	if (!wallclockpid) {
+		if (out) {
+			dup2(fds[1], STDOUT_FILENO);
+			close(fds[0]);
+			close(fds[1]);
+		}
+		execv(argv[0], (char *const*)argv);
+		_exit(127);
+	}
+	if (out) {
+		close(fds[1]);
+		*out = fds[0];
+	}
+	for (int i = 0; i < 100; ++i) {
+		if (waitpid(wallclockpid, NULL, WNOHANG)) {
+			wallclockpid = -1;
+			return false;
+		}
+		if (XGetWindowAttributes(dpy, DefaultRootWindow(dpy), &wa)
+		 && wa.all_event_masks & ExposureMask) {
+			/* and let it finish starting up */
+			msleep(500);
+			return true;
+		}
+		msleep(100);
+	}
+	return false;
+}
+
+/* Whether the wallclock started is still running. */
+static bool
+alive(void) {
+	return wallclockpid > 0 && !waitpid(wallclockpid, NULL, WNOHANG);
+}
+
+/* CPU time used by process pid, in clock ticks, or -1. */
+static long
+cputicks(pid_t pid) {
+	char path[64], buf[1024], *p;
+	unsigned long ut, st;
+	size_t n;
+	FILE *f;
+
+	snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+	if (!(f = fopen(path, "r"))) {
+		return -1;
+	}
+	n = fread(buf, 1, sizeof(buf) - 1, f);
+	fclose(f);
+	buf[n] = '\0';
+	/* the command name may hold anything, so count fields from its end */
+	if (!(p = strrchr(buf, ')'))
+	 || sscanf(p + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &ut, &st) != 2) {
+		return -1;
+	}
+	return ut + st;
+}
+
+#endif
@@ -0,0 +1,161 @@
+#include <sys/timerfd.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "timer.h"
+#include "tz.h"
+
+static void
+realnow(struct timespec *ts) {
+	clock_gettime(CLOCK_REALTIME, ts);
+}
+
+static int
+realarm(int fd, const struct timespec *at) {
+	struct itimerspec its = { .it_value = *at };
+	/* settimeofday, NTP steps and resume make the read fail with ECANCELED */
+	return timerfd_settime(fd, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET, &its, NULL);
+}
+
+static ssize_t
+realread(int fd, uint64_t *expirations) {
+	return read(fd, expirations, sizeof(*expirations));
+}
+
+static const struct timerops_t realops = { realnow, realarm, realread };
+
+static struct {
+	const struct timerops_t *ops;
+	int fd;
+	enum unit_t unit;
+	int rate;
+	long offset;
+	struct timespec next;
+} timer = {
+	.ops = &realops,
+	.fd = -1,
+};
+
+int
+timerinit(const struct timerops_t *ops, enum unit_t unit, int rate, long offset) {
+	timer.ops = ops ? ops : &realops;
+	timer.unit = unit;
+	timer.rate = rate;
+	timer.offset = offset;
+	timer.fd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+	return timer.fd;
+}
+
+void
+timernow(struct timespec *ts) {
+	timer.ops->now(ts);
+}
+
+time_t
+timerboundary(time_t t, enum unit_t unit) {
+	struct tm tm;
+	time_t next, change;
+
+	if (unit == UNIT_SECOND || !tzlocal(t, &tm)) {
+		return t + 1;
+	}
+	switch (unit) {
+	case UNIT_MINUTE:
+		next = t - tm.tm_sec + 60;
+		break;
+	case UNIT_HOUR:
+		next = t - tm.tm_min * 60 - tm.tm_sec + 3600;
+		break;
+	default:
+		next = t - tm.tm_hour * 3600 - tm.tm_min * 60 - tm.tm_sec + 86400;
+		break;
+	}
+	if ((change = tznext(t)) > t && change < next) {
+		next = change;
+	}
+	return next;
+}
+
+static void
+tsadd(struct timespec *ts, long ns) {
+	ts->tv_nsec += ns;
+	while (ts->tv_nsec >= 1000000000L) {
+		ts->tv_nsec -= 1000000000L;
+		++ts->tv_sec;
+	}
+	while (ts->tv_nsec < 0) {
+		ts->tv_nsec += 1000000000L;
+		--ts->tv_sec;
+	}
+}
+
+struct timespec
+timerframe(const struct timespec *now) {
+	struct timespec next = { now->tv_sec, 0 };
+	if (timer.rate <= 1) {
+		next.tv_sec = timerboundary(now->tv_sec, timer.unit);
+		return next;
+	}
+	/* frame k is at ceil(k / rate) seconds */
+	long long k = (long long)now->tv_nsec * timer.rate / 1000000000L + 1;
+	if (k < timer.rate) {
+		next.tv_nsec = (k * 1000000000LL + timer.rate - 1) / timer.rate;
+	} else {
+		++next.tv_sec;
+	}
+	return next;
+}
+
+const struct timespec *
+timernext() {
+	return &timer.next;
+}
+
+int
+timerarm(const struct timespec *now) {
+	struct timespec at;
+	timer.next = timerframe(now);
+	at = timer.next;
+	tsadd(&at, timer.offset);
+	return timer.ops->arm(timer.fd, &at);
+}
+
+int
+timerhandle(timercb_t cb, void *arg) {
+	struct timespec now;
+	uint64_t expirations;
+	int ev = TIMER_DUE;
+	if (timer.ops->read(timer.fd, &expirations) < 0) {
+		if (errno == ECANCELED) {
+			/* redraw at the new time rather than at the next boundary */
+			ev = TIMER_SET;
+		} else if (errno != EAGAIN) {
+			return -1;
+		}
+	}
+	timer.ops->now(&now);
+	cb(&now, ev == TIMER_DUE, arg);
+	timer.ops->now(&now);
+	return timerarm(&now) < 0 ? -1 : ev;
+}
+
+int
+timerdue(timercb_t cb, void *arg) {
+	struct timespec now;
+	timer.ops->now(&now);
+	if (now.tv_sec < timer.next.tv_sec
+	 || (now.tv_sec == timer.next.tv_sec && now.tv_nsec < timer.next.tv_nsec)) {
+		return 0;
+	}
+	cb(&now, true, arg);
+	timer.ops->now(&now);
+	return timerarm(&now) < 0 ? -1 : 1;
+}
+
+void
+timercleanup() {
+	if (timer.fd >= 0) {
+		close(timer.fd);
+		timer.fd = -1;
+	}
+}
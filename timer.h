@@ -0,0 +1,65 @@
+/* When to update: the next instant at which a display of some unit of
+ * time changes, and a timer armed for it that is cancelled when the
+ * clock is set. The clock and the timer can be replaced, so that tests
+ * can step time. */
+
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
+
+enum unit_t {
+	UNIT_SECOND = 1,
+	UNIT_MINUTE = 60,
+	UNIT_HOUR   = 3600,
+	UNIT_DAY    = 86400,
+};
+
+enum {
+	TIMER_DUE,
+	/* the clock was set, so the update is not for the boundary armed */
+	TIMER_SET,
+};
+
+struct timerops_t {
+	void (*now)(struct timespec *ts);
+	/* Arm fd for the absolute time at, to be cancelled when the clock is
+	 * set. Returns -1 on failure. */
+	int (*arm)(int fd, const struct timespec *at);
+	/* As read(2) of a timerfd, failing with ECANCELED after a set. */
+	ssize_t (*read)(int fd, uint64_t *expirations);
+};
+
+/* Called with the time of an update and whether it is for the boundary
+ * the timer was armed for. */
+typedef void (*timercb_t)(const struct timespec *now, bool ontime, void *arg);
+
+/* Update every unit, or rate times a second if rate is above 1, arming
+ * the timer offset ns from each update. ops may be NULL for CLOCK_REALTIME
+ * and a timerfd. Returns the descriptor to poll, or -1. */
+int timerinit(const struct timerops_t *ops, enum unit_t unit, int rate, long offset);
+void timernow(struct timespec *ts);
+/* First instant after t at which a display of unit changes, which
+ * includes any change of UTC offset. */
+time_t timerboundary(time_t t, enum unit_t unit);
+/* First update after now. Updates within a second are evenly spaced from
+ * the whole second, so that a new second is always shown on time. */
+struct timespec timerframe(const struct timespec *now);
+/* The update the timer is armed for. */
+const struct timespec *timernext(void);
+/* Arm the timer for the first update after now. */
+int timerarm(const struct timespec *now);
+/* Read the timer and call cb at once, even if the clock was set rather
+ * than the timer expiring, then arm the timer from the time after cb.
+ * Returns TIMER_DUE or TIMER_SET, or -1 with errno set. */
+int timerhandle(timercb_t cb, void *arg);
+/* The same when the update is due without the timer having fired, as
+ * after a wait with a timeout. Returns 1 if it was due, 0 if not yet, or
+ * -1 with errno set. */
+int timerdue(timercb_t cb, void *arg);
+void timercleanup(void);
+
+#endif
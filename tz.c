@@ -0,0 +1,601 @@
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tz.h"
+
+#define ZONEDIR   "/usr/share/zoneinfo"
+#define LOCALTIME "/etc/localtime"
+#define WATCHMASK (IN_CREATE | IN_MOVED_TO | IN_CLOSE_WRITE | IN_DELETE | IN_ATTRIB \
+                   | IN_DELETE_SELF | IN_MOVE_SELF)
+
+struct ttinfo_t {
+	long off;
+	bool isdst;
+	const char *abbr;
+};
+
+/* One end of a POSIX TZ daylight saving rule. */
+struct rule_t {
+	enum {
+		R_JULIAN,
+		R_ZERO,
+		R_MONTH,
+	} type;
+	int day, week, mon;
+	long secs;
+};
+
+struct zone_t {
+	int ntimes;
+	int64_t *times;
+	unsigned char *idx;
+	int ntypes;
+	struct ttinfo_t *types;
+	char *chars;
+	/* POSIX TZ string, for times after the last transition */
+	bool hasrule;
+	bool hasdst;
+	struct ttinfo_t std, dst;
+	struct rule_t start, end;
+	char names[2][16];
+};
+
+static struct {
+	struct zone_t *zone;
+	const char *path;
+	char file[PATH_MAX];
+	char base[NAME_MAX + 1];
+	/* the directory that zonewd watches */
+	char dir[PATH_MAX];
+	int fd;
+	int etcwd;
+	int zonewd;
+} tz = {
+	.fd = -1,
+	.etcwd = -1,
+	.zonewd = -1,
+};
+
+static int64_t
+daysfromcivil(int64_t y, unsigned m, unsigned d) {
+	y -= m <= 2;
+	int64_t era = (y >= 0 ? y : y - 399) / 400;
+	unsigned yoe = (unsigned)(y - era * 400);
+	unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+	unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + (int64_t)doe - 719468;
+}
+
+static void
+civilfromdays(int64_t z, int64_t *y, unsigned *m, unsigned *d) {
+	z += 719468;
+	int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+	unsigned doe = (unsigned)(z - era * 146097);
+	unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	unsigned mp = (5 * doy + 2) / 153;
+	*d = doy - (153 * mp + 2) / 5 + 1;
+	*m = mp < 10 ? mp + 3 : mp - 9;
+	*y = (int64_t)yoe + era * 400 + (*m <= 2);
+}
+
+static bool
+isleap(int64_t y) {
+	return (y % 4 == 0 && y % 100 != 0) || y % 400 == 0;
+}
+
+static int64_t
+floordiv(int64_t a, int64_t b) {
+	return a / b - (a % b != 0 && (a < 0) != (b < 0));
+}
+
+/* UTC instant at which a rule fires in a year, given the offset in effect
+ * before it. */
+static int64_t
+ruletime(const struct rule_t *r, int64_t year, long off) {
+	int64_t days = daysfromcivil(year, 1, 1);
+	switch (r->type) {
+	case R_JULIAN:
+		days += r->day - 1 + (isleap(year) && r->day >= 60);
+		break;
+	case R_ZERO:
+		days += r->day;
+		break;
+	case R_MONTH: {
+		static const int mdays[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+		int64_t first = daysfromcivil(year, r->mon, 1);
+		int wday = (int)((first % 7 + 7 + 4) % 7);
+		int len = mdays[r->mon - 1] + (r->mon == 2 && isleap(year));
+		int d = (r->day - wday + 7) % 7 + (r->week - 1) * 7;
+		if (d >= len) {
+			d -= 7;
+		}
+		days = first + d;
+		break;
+	}
+	}
+	return days * 86400 + r->secs - off;
+}
+
+static const char *
+parsename(const char *s, char *name, size_t size) {
+	const char *begin = s, *end;
+	if (*s == '<') {
+		if (!(end = strchr(++begin, '>'))) {
+			return NULL;
+		}
+		s = end + 1;
+	} else {
+		while (isalpha((unsigned char)*s)) {
+			++s;
+		}
+		end = s;
+	}
+	if (end == begin || (size_t)(end - begin) >= size) {
+		return NULL;
+	}
+	memcpy(name, begin, end - begin);
+	name[end - begin] = '\0';
+	return s;
+}
+
+/* [+-]hh[:mm[:ss]] */
+static const char *
+parsetime(const char *s, long *secs) {
+	long sign = 1, v[3] = { 0 };
+	if (*s == '+' || *s == '-') {
+		sign = *s++ == '-' ? -1 : 1;
+	}
+	for (int i = 0; i < 3; ++i) {
+		char *end;
+		if (!isdigit((unsigned char)*s)) {
+			return NULL;
+		}
+		v[i] = strtol(s, &end, 10);
+		s = end;
+		if (*s != ':') {
+			break;
+		}
+		++s;
+	}
+	*secs = sign * (v[0] * 3600 + v[1] * 60 + v[2]);
+	return s;
+}
+
+static const char *
+parserule(const char *s, struct rule_t *r) {
+	char *end;
+	if (*s == 'J') {
+		r->type = R_JULIAN;
+		r->day = strtol(s + 1, &end, 10);
+		if (end == s + 1 || r->day < 1 || r->day > 365) {
+			return NULL;
+		}
+	} else if (*s == 'M') {
+		r->type = R_MONTH;
+		r->mon = strtol(s + 1, &end, 10);
+		if (*end != '.') {
+			return NULL;
+		}
+		r->week = strtol(end + 1, &end, 10);
+		if (*end != '.') {
+			return NULL;
+		}
+		r->day = strtol(end + 1, &end, 10);
+		if (r->mon < 1 || r->mon > 12 || r->week < 1 || r->week > 5 || r->day < 0 || r->day > 6) {
+			return NULL;
+		}
+	} else if (isdigit((unsigned char)*s)) {
+		r->type = R_ZERO;
+		r->day = strtol(s, &end, 10);
+		if (r->day > 365) {
+			return NULL;
+		}
+	} else {
+		return NULL;
+	}
+	s = end;
+	r->secs = 7200;
+	if (*s == '/') {
+		s = parsetime(s + 1, &r->secs);
+	}
+	return s;
+}
+
+/* std offset [dst [offset] [,start[/time],end[/time]]] */
+static bool
+parseposix(struct zone_t *z, const char *s) {
+	long off;
+	if (!(s = parsename(s, z->names[0], sizeof(z->names[0])))
+	 || !(s = parsetime(s, &off))) {
+		return false;
+	}
+	z->std = (struct ttinfo_t){ -off, false, z->names[0] };
+	z->hasrule = true;
+	if (!*s) {
+		return true;
+	}
+	if (!(s = parsename(s, z->names[1], sizeof(z->names[1])))) {
+		return false;
+	}
+	z->dst = (struct ttinfo_t){ z->std.off + 3600, true, z->names[1] };
+	z->hasdst = true;
+	if (*s && *s != ',') {
+		if (!(s = parsetime(s, &off))) {
+			return false;
+		}
+		z->dst.off = -off;
+	}
+	if (!*s) {
+		/* the POSIX default, as glibc has it */
+		s = ",M3.2.0,M11.1.0";
+	}
+	if (*s++ != ','
+	 || !(s = parserule(s, &z->start)) || *s++ != ','
+	 || !(s = parserule(s, &z->end))) {
+		return false;
+	}
+	return !*s;
+}
+
+static uint32_t
+be32(const unsigned char *p) {
+	return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static int64_t
+be64(const unsigned char *p) {
+	return (int64_t)((uint64_t)be32(p) << 32 | be32(p + 4));
+}
+
+static void
+freezone(struct zone_t *z) {
+	if (z) {
+		free(z->times);
+		free(z->idx);
+		free(z->types);
+		free(z->chars);
+		free(z);
+	}
+}
+
+/* RFC 8536. Files with leap seconds are left to the C library. */
+static bool
+parsetzif(struct zone_t *z, const unsigned char *p, size_t size) {
+	const unsigned char *end = p + size;
+	size_t tsize = 4;
+	uint32_t isutcnt, isstdcnt, leapcnt, timecnt, typecnt, charcnt;
+
+	for (;;) {
+		if (end - p < 44 || memcmp(p, "TZif", 4)) {
+			return false;
+		}
+		isutcnt  = be32(p + 20);
+		isstdcnt = be32(p + 24);
+		leapcnt  = be32(p + 28);
+		timecnt  = be32(p + 32);
+		typecnt  = be32(p + 36);
+		charcnt  = be32(p + 40);
+		size_t len = timecnt * tsize + timecnt + typecnt * 6 + charcnt
+		           + leapcnt * (tsize + 4) + isstdcnt + isutcnt;
+		if (typecnt == 0 || (size_t)(end - p) - 44 < len) {
+			return false;
+		}
+		if (tsize == 8 || p[4] < '2') {
+			p += 44;
+			break;
+		}
+		/* skip the 32-bit block of a version 2+ file */
+		p += 44 + len;
+		tsize = 8;
+	}
+	if (leapcnt) {
+		return false;
+	}
+
+	z->ntimes = timecnt;
+	z->ntypes = typecnt;
+	if (!(z->times = calloc(timecnt + 1, sizeof(*z->times)))
+	 || !(z->idx = calloc(timecnt + 1, 1))
+	 || !(z->types = calloc(typecnt, sizeof(*z->types)))
+	 || !(z->chars = calloc(charcnt + 1, 1))) {
+		return false;
+	}
+	for (uint32_t i = 0; i < timecnt; ++i, p += tsize) {
+		z->times[i] = tsize == 8 ? be64(p) : (int32_t)be32(p);
+	}
+	for (uint32_t i = 0; i < timecnt; ++i, ++p) {
+		if ((z->idx[i] = *p) >= typecnt) {
+			return false;
+		}
+	}
+	const unsigned char *types = p;
+	p += typecnt * 6;
+	memcpy(z->chars, p, charcnt);
+	for (uint32_t i = 0; i < typecnt; ++i, types += 6) {
+		if (types[5] >= charcnt) {
+			return false;
+		}
+		z->types[i].off = (int32_t)be32(types);
+		z->types[i].isdst = types[4];
+		z->types[i].abbr = z->chars + types[5];
+	}
+	p += charcnt + leapcnt * (tsize + 4) + isstdcnt + isutcnt;
+
+	/* footer: \n TZ string \n */
+	if (tsize == 8 && p < end && *p == '\n') {
+		const unsigned char *nl = memchr(p + 1, '\n', end - p - 1);
+		char posix[64];
+		if (nl && nl > p + 1 && (size_t)(nl - p - 1) < sizeof(posix)) {
+			memcpy(posix, p + 1, nl - p - 1);
+			posix[nl - p - 1] = '\0';
+			if (!parseposix(z, posix)) {
+				z->hasrule = z->hasdst = false;
+			}
+		}
+	}
+	return true;
+}
+
+static struct zone_t *
+loadfile(const char *path) {
+	struct zone_t *z;
+	struct stat st;
+	void *map;
+	int fd;
+	bool ok;
+
+	if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0) {
+		return NULL;
+	}
+	if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size == 0
+	 || (map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+		close(fd);
+		return NULL;
+	}
+	close(fd);
+	if ((z = calloc(1, sizeof(*z)))) {
+		ok = parsetzif(z, map, st.st_size);
+		if (!ok) {
+			freezone(z);
+			z = NULL;
+		}
+	}
+	munmap(map, st.st_size);
+	return z;
+}
+
+/* Follow TZ the way the C library does: unset means /etc/localtime, a
+ * name is looked for under the zone directory, and anything that is not
+ * a file may be a POSIX TZ string. */
+static struct zone_t *
+load() {
+	const char *env = getenv("TZ");
+	struct zone_t *z;
+
+	if (!env) {
+		tz.path = LOCALTIME;
+		return loadfile(tz.path);
+	}
+	if (*env == ':') {
+		++env;
+	}
+	if (!*env) {
+		env = "UTC0";
+	}
+	if (*env == '/') {
+		tz.path = env;
+	} else {
+		const char *dir = getenv("TZDIR");
+		snprintf(tz.file, sizeof(tz.file), "%s/%s", dir ? dir : ZONEDIR, env);
+		tz.path = tz.file;
+	}
+	if ((z = loadfile(tz.path))) {
+		return z;
+	}
+	tz.path = NULL;
+	if ((z = calloc(1, sizeof(*z))) && !parseposix(z, env)) {
+		freezone(z);
+		z = NULL;
+	}
+	return z;
+}
+
+/* Watch the directory holding the zone file, wherever /etc/localtime
+ * happens to point now. The watch is kept if that is the directory
+ * already watched, unless moved says it has been replaced. */
+static void
+watch(bool moved) {
+	char real[PATH_MAX], *slash;
+
+	if (tz.fd < 0 || !tz.path || !realpath(tz.path, real) || !(slash = strrchr(real, '/'))) {
+		real[0] = '\0';
+		slash = NULL;
+	} else {
+		snprintf(tz.base, sizeof(tz.base), "%s", slash + 1);
+		*slash = '\0';
+	}
+	if (tz.zonewd >= 0 && slash && !moved && !strcmp(real, tz.dir)) {
+		return;
+	}
+	/* the IN_IGNORED this queues is for a watch no longer ours */
+	if (tz.zonewd >= 0 && tz.zonewd != tz.etcwd) {
+		inotify_rm_watch(tz.fd, tz.zonewd);
+	}
+	tz.zonewd = -1;
+	tz.dir[0] = '\0';
+	if (!slash) {
+		return;
+	}
+	snprintf(tz.dir, sizeof(tz.dir), "%s", *real ? real : "/");
+	tz.zonewd = inotify_add_watch(tz.fd, tz.dir, WATCHMASK);
+}
+
+int
+tzinit() {
+	tz.zone = load();
+	if ((tz.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0) {
+		return -1;
+	}
+	if (!getenv("TZ")) {
+		tz.etcwd = inotify_add_watch(tz.fd, "/etc", WATCHMASK);
+	}
+	watch(false);
+	return tz.fd;
+}
+
+bool
+tzhandle() {
+	char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	bool reload = false, moved = false;
+	ssize_t n;
+
+	while ((n = read(tz.fd, buf, sizeof(buf))) > 0) {
+		for (char *p = buf; p < buf + n; ) {
+			struct inotify_event *ev = (struct inotify_event*)p;
+			p += sizeof(*ev) + ev->len;
+			if (ev->mask & IN_Q_OVERFLOW) {
+				reload = true;
+			} else if (ev->wd != tz.etcwd && ev->wd != tz.zonewd) {
+				/* left over from a watch we have removed */
+				continue;
+			} else if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+				reload = true;
+				moved |= ev->wd == tz.zonewd;
+				if (ev->mask & IN_IGNORED) {
+					/* the kernel has dropped the watch itself */
+					tz.etcwd = ev->wd == tz.etcwd ? -1 : tz.etcwd;
+					tz.zonewd = ev->wd == tz.zonewd ? -1 : tz.zonewd;
+				}
+			} else if (ev->len && ev->wd == tz.etcwd && !strcmp(ev->name, "localtime")) {
+				reload = true;
+			} else if (ev->len && ev->wd == tz.zonewd && !strcmp(ev->name, tz.base)) {
+				reload = true;
+			}
+		}
+	}
+	if (!reload) {
+		return false;
+	}
+	freezone(tz.zone);
+	tz.zone = load();
+	watch(moved);
+	return true;
+}
+
+static const struct ttinfo_t *
+rulelookup(const struct zone_t *z, int64_t t) {
+	if (!z->hasdst) {
+		return &z->std;
+	}
+	int64_t y;
+	unsigned m, d;
+	civilfromdays(floordiv(t + z->std.off, 86400), &y, &m, &d);
+	int64_t start = ruletime(&z->start, y, z->std.off);
+	int64_t end = ruletime(&z->end, y, z->dst.off);
+	bool dst = start < end ? t >= start && t < end : !(t >= end && t < start);
+	return dst ? &z->dst : &z->std;
+}
+
+/* Index of the last transition at or before t, or -1. */
+static int
+search(const struct zone_t *z, int64_t t) {
+	int lo = 0, hi = z->ntimes;
+	while (lo < hi) {
+		int mid = lo + (hi - lo) / 2;
+		if (z->times[mid] <= t) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo - 1;
+}
+
+static const struct ttinfo_t *
+lookup(const struct zone_t *z, int64_t t) {
+	int i = search(z, t);
+	if (z->hasrule && (z->ntimes == 0 || (i >= 0 && i == z->ntimes - 1))) {
+		return rulelookup(z, t);
+	}
+	return &z->types[i < 0 ? 0 : z->idx[i]];
+}
+
+bool
+tzlocal(time_t t, struct tm *tm) {
+	const struct zone_t *z = tz.zone;
+	if (!z) {
+		return localtime_r(&t, tm) != NULL;
+	}
+	const struct ttinfo_t *tt = lookup(z, t);
+	int64_t secs = (int64_t)t + tt->off;
+	int64_t days = floordiv(secs, 86400), rem = secs - days * 86400, y;
+	unsigned m, d;
+
+	civilfromdays(days, &y, &m, &d);
+	tm->tm_sec = rem % 60;
+	tm->tm_min = rem / 60 % 60;
+	tm->tm_hour = rem / 3600;
+	tm->tm_mday = d;
+	tm->tm_mon = m - 1;
+	tm->tm_year = y - 1900;
+	tm->tm_wday = (int)((days % 7 + 7 + 4) % 7);
+	tm->tm_yday = (int)(days - daysfromcivil(y, 1, 1));
+	tm->tm_isdst = tt->isdst;
+	tm->tm_gmtoff = tt->off;
+	tm->tm_zone = tt->abbr;
+	return true;
+}
+
+time_t
+tznext(time_t t) {
+	const struct zone_t *z = tz.zone;
+	if (!z) {
+		/* no table; quarter hours catch every offset in use */
+		return t - t % 900 + 900;
+	}
+	int i = search(z, t);
+	if (i + 1 < z->ntimes) {
+		return z->times[i + 1];
+	}
+	if (!z->hasrule || !z->hasdst) {
+		return -1;
+	}
+	int64_t y, next = -1;
+	unsigned m, d;
+	civilfromdays(floordiv((int64_t)t + z->std.off, 86400), &y, &m, &d);
+	for (int64_t yy = y - 1; yy <= y + 1; ++yy) {
+		int64_t s = ruletime(&z->start, yy, z->std.off);
+		int64_t e = ruletime(&z->end, yy, z->dst.off);
+		if (s > t && (next < 0 || s < next)) {
+			next = s;
+		}
+		if (e > t && (next < 0 || e < next)) {
+			next = e;
+		}
+	}
+	return next;
+}
+
+void
+tzcleanup() {
+	freezone(tz.zone);
+	tz.zone = NULL;
+	if (tz.fd >= 0) {
+		close(tz.fd);
+		tz.fd = -1;
+	}
+	/* the watches went with the descriptor */
+	tz.etcwd = -1;
+	tz.zonewd = -1;
+	tz.dir[0] = '\0';
+}
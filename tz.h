@@ -0,0 +1,21 @@
+/* Local time from a TZif file that is read once, so that converting a
+ * time makes no system calls. The zone is reloaded when inotify reports
+ * that /etc/localtime or the zone file has changed. */
+
+#ifndef TZ_H
+#define TZ_H
+
+#include <stdbool.h>
+#include <time.h>
+
+/* Load the zone named by TZ, or /etc/localtime. On failure, localtime_r
+ * is used instead. Returns the inotify descriptor to poll, or -1. */
+int tzinit(void);
+/* Read pending inotify events. Returns true if the zone was reloaded. */
+bool tzhandle(void);
+bool tzlocal(time_t t, struct tm *tm);
+/* First instant after t at which the UTC offset or abbreviation changes. */
+time_t tznext(time_t t);
+void tzcleanup(void);
+
+#endif
@@ -20,20 +20,58 @@
  */
 
 #include <X11/extensions/Xinerama.h>
+#include <X11/extensions/XRes.h>
+#include <X11/extensions/Xrandr.h>
+#include <X11/extensions/XShm.h>
 #include <X11/Xft/Xft.h>
+#include <X11/Xatom.h>
 #include <X11/Xutil.h>
+#ifdef USE_XCB
+#include <X11/Xlib-xcb.h>
+#include <xcb/xinerama.h>
+#endif
 #include <err.h>
+#include <errno.h>
 #include <locale.h>
-#include <poll.h>
+#include <sched.h>
 #include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
+#include <sys/epoll.h>
+#include <sys/ipc.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/shm.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
 #include <time.h>
 #include <unistd.h>
 
 #include "arg.h"
+#include "blend.h"
+#include "evloop.h"
+#include "format.h"
+#include "pool.h"
+#include "raster.h"
+#include "timer.h"
+#include "tz.h"
+
+#ifndef SCHED_IDLE
+#define SCHED_IDLE 5
+#endif
+#define IOPRIO_WHO_PROCESS 1
+#define IOPRIO_CLASS_IDLE  3
+#define IOPRIO_CLASS_SHIFT 13
+
+/* how long before the boundary a precise tick wakes to render */
+#define PRECISE_LEADNS 10000000L
+#define PREFAULT_STACK (256 * 1024)
+#define HIST_BUCKETS   16
+#define LAT_MAX        1024
 
 struct linearg_t {
 	const char *fmt;
@@ -46,6 +84,18 @@ static struct {
 	const char *background;
 	int debug;
 	int screen;
+	bool allheads;
+	bool atlas;
+	bool latency;
+	bool rootbg;
+	bool oneshot;
+	int slack;
+	bool precise;
+	int rtprio;
+	int fps;
+	int threads;
+	bool shm;
+	double gamma;
 } args = {
 	.text1 = {
 		.fmt   = "%H:%M",
@@ -62,189 +112,1938 @@ static struct {
 	.background = "#000000",
 	.debug = 1,
 	.screen = -1,
+	.fps = 30,
+};
+
+static bool running = true;
+static struct timespec start;
+
+static struct {
+	int fd;
+	int tzfd;
+} sched;
+
+static struct {
+	time_t since;
+	unsigned long wakeups;
+	unsigned long clocksets;
+	unsigned long ticks;
+	long long latens;
+	long long maxlatens;
+	unsigned long long pixels;
+	unsigned long long inked;
+	unsigned long long banded;
+	unsigned long updates;
+	unsigned long requests;
+	unsigned long long reqbytes;
+	long long renderns;
+	unsigned long roundtrips;
+	long long roundtripns;
+	unsigned long frames;
+	struct timespec cpu;
+	long long servercpu;
+	unsigned long swframes;
+	long long swrenderns;
+	long long swsubmitns;
+	long long swskewns;
+	long long maxswskewns;
+	unsigned long shmwaits;
+	/* boundary to copy completion, bucket i below 64us << i */
+	unsigned long hist[HIST_BUCKETS];
+} stats;
+
+/* The last LAT_MAX updates on time, each with how long after its
+ * boundary the timer woke us, the frame was rendered and, when there was
+ * a round-trip, the server had done the copy. */
+static struct {
+	struct {
+		struct timespec boundary;
+		long long wake;
+		long long render;
+		long long ack;
+		bool acked;
+	} ring[LAT_MAX];
+	unsigned long n;
+	int pending;
+} lat = { .pending = -1 };
+
+#define ATLAS_MAX 128
+
+/* Glyphs of one line, pre-rendered side by side into a pixmap. Each glyph
+ * is stored by its ink box only, at atlas x, with a shared baseline. */
+struct atlas_t {
+	Pixmap pm;
+	int baseline;
+	int n;
+	struct {
+		FcChar32 ucs;
+		int x;
+		XGlyphInfo ext;
+	} glyph[ATLAS_MAX];
+};
+
+/* A line of text as formatted, with what it is drawn with. All heads
+ * share it. */
+struct line_t {
+	char buf[FMT_OUTSZ];
+	struct fmt_t fmt;
+	int ascent;
+	int height;
+	unsigned long redraws;
+	XftFont *xfont;
+	XftColor color;
+	struct atlas_t *atlas;
+	struct rfont_t rfont;
+	int ridx[FMT_OUTSZ];
+	int nridx;
+	const struct linearg_t *arg;
+};
+
+/* Where a line sits on one head, and what was last drawn there. */
+struct place_t {
+	char buf[FMT_OUTSZ];
+	int y;
+	int x;
+	int advance;
+	bool warned;
+	XRectangle ink;
+	XRectangle damage;
 };
 
-static bool running = true;
+/* A line to draw in software on one head, clearing box first. */
+struct swop_t {
+	const struct line_t *line;
+	XRectangle box;
+	int x;
+	int baseline;
+};
+
+/* A monitor and the pixmap its clock is drawn in. In software, the
+ * pixmap is a copy of the image, which has the whole picture. */
+struct head_t {
+	int x, y;
+	int w, h;
+	XRectangle band;
+	Drawable da;
+	XftDraw *draw;
+	Pixmap back;
+	XftDraw *backdraw;
+	XRectangle stale;
+	Region damage;
+	XImage *ximg;
+	XShmSegmentInfo shm;
+	struct rimage_t img;
+	struct swop_t ops[2];
+	int nops;
+	struct timespec rendered;
+	struct place_t text1, text2;
+};
+
+static struct {
+	XColor bg;
+	Display *dpy;
+	int screen;
+	Window root;
+	GC gc;
+	Pixmap prevpm;
+	Colormap cmap;
+	Visual *vis;
+	bool dirty;
+	struct line_t text1, text2;
+	struct head_t *heads;
+	int nheads;
+	int rrevbase;
+	int shmevbase;
+	/* XShmPutImage requests whose ShmCompletion has not come yet */
+	int shmpending;
+} dc = { .rrevbase = -1 };
+
+static void
+unionrect(XRectangle *dst, const XRectangle *src) {
+	if (!src->width || !src->height) {
+		return;
+	}
+	if (!dst->width || !dst->height) {
+		*dst = *src;
+		return;
+	}
+	int x1 = dst->x < src->x ? dst->x : src->x;
+	int y1 = dst->y < src->y ? dst->y : src->y;
+	int x2 = dst->x + dst->width > src->x + src->width ? dst->x + dst->width : src->x + src->width;
+	int y2 = dst->y + dst->height > src->y + src->height ? dst->y + dst->height : src->y + src->height;
+	dst->x = x1;
+	dst->y = y1;
+	dst->width = x2 - x1;
+	dst->height = y2 - y1;
+}
+
+/* Mark a rectangle of the root window as exposed, on every head. */
+static void
+damage(int x, int y, int w, int h) {
+	for (int i = 0; i < dc.nheads; ++i) {
+		struct head_t *head = &dc.heads[i];
+		XRectangle r = { x - head->x, y - head->y, w, h };
+		XUnionRectWithRegion(&r, head->damage, head->damage);
+	}
+}
+
+static struct place_t *
+placeof(struct head_t *head, const struct line_t *line) {
+	return line == &dc.text1 ? &head->text1 : &head->text2;
+}
+
+static bool
+cliprect(XRectangle *r, int w, int h) {
+	int x1 = r->x < 0 ? 0 : r->x;
+	int y1 = r->y < 0 ? 0 : r->y;
+	int x2 = r->x + r->width  > w ? w : r->x + r->width;
+	int y2 = r->y + r->height > h ? h : r->y + r->height;
+	if (x2 <= x1 || y2 <= y1) {
+		*r = (XRectangle){ 0 };
+		return false;
+	}
+	*r = (XRectangle){ x1, y1, x2 - x1, y2 - y1 };
+	return true;
+}
+
+/* Each line blits its own damage, independently of the other line. */
+static void
+flushline(struct head_t *head, struct place_t *place) {
+	XRectangle r = place->damage;
+	if (!cliprect(&r, head->band.width, head->band.height)) {
+		;
+	} else if (args.rootbg) {
+		/* the server repaints from the background pixmap */
+		XClearArea(dc.dpy, dc.root, head->x + head->band.x + r.x, head->y + head->band.y + r.y,
+		           r.width, r.height, False);
+	} else {
+		XCopyArea(dc.dpy, head->da, dc.root, dc.gc, r.x, r.y, r.width, r.height,
+		          head->x + head->band.x + r.x, head->y + head->band.y + r.y);
+		stats.pixels += (unsigned long long)r.width * r.height;
+		/* now on screen, but not yet in the back pixmap */
+		unionrect(&head->stale, &r);
+	}
+	place->damage = (XRectangle){ 0 };
+}
+
+static long long
+nsec(const struct timespec *a, const struct timespec *b) {
+	return (b->tv_sec - a->tv_sec) * 1000000000LL + b->tv_nsec - a->tv_nsec;
+}
+
+/* A round-trip, made only when asked to. Otherwise only shmwait() and
+ * setting up waits for the server. */
+static void
+roundtrip() {
+	struct timespec t0, t1;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	XSync(dc.dpy, False);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	++stats.roundtrips;
+	stats.roundtripns += nsec(&t0, &t1);
+}
+
+/* Note an update on time, just rendered, for the boundary that woke us.
+ * Returns its place in the ring. */
+static int
+latrecord(const struct timespec *boundary, const struct timespec *wake) {
+	struct timespec t;
+	int i = lat.n++ % LAT_MAX;
+	clock_gettime(CLOCK_REALTIME, &t);
+	lat.ring[i].boundary = *boundary;
+	lat.ring[i].wake = nsec(boundary, wake);
+	lat.ring[i].render = nsec(boundary, &t);
+	lat.ring[i].acked = false;
+	return lat.pending = i;
+}
+
+/* To be called right after a round-trip that followed the update. */
+static void
+latack(int i) {
+	struct timespec t;
+	if (i < 0) {
+		return;
+	}
+	clock_gettime(CLOCK_REALTIME, &t);
+	lat.ring[i].ack = nsec(&lat.ring[i].boundary, &t);
+	lat.ring[i].acked = true;
+}
+
+/* Exposed parts of the monitor outside the text band have no backing
+ * store; the server fills them with the background. */
+static void
+flushhead(struct head_t *head) {
+	XRectangle r = { 0, 0, head->w, head->h };
+	Region bounds = XCreateRegion();
+	Region band = XCreateRegion();
+
+	flushline(head, &head->text1);
+	flushline(head, &head->text2);
+
+	XUnionRectWithRegion(&r, bounds, bounds);
+	XIntersectRegion(head->damage, bounds, head->damage);
+	if (!XEmptyRegion(head->damage)) {
+		XUnionRectWithRegion(&head->band, band, band);
+		XIntersectRegion(head->damage, band, band);
+		XSubtractRegion(head->damage, band, bounds);
+		XSetClipOrigin(dc.dpy, dc.gc, head->x, head->y);
+		if (!XEmptyRegion(bounds)) {
+			XClipBox(bounds, &r);
+			XSetRegion(dc.dpy, dc.gc, bounds);
+			XSetForeground(dc.dpy, dc.gc, dc.bg.pixel);
+			XFillRectangle(dc.dpy, dc.root, dc.gc, head->x + r.x, head->y + r.y, r.width, r.height);
+		}
+		if (!XEmptyRegion(band)) {
+			XClipBox(band, &r);
+			XSetRegion(dc.dpy, dc.gc, band);
+			XCopyArea(dc.dpy, head->da, dc.root, dc.gc,
+			          r.x - head->band.x, r.y - head->band.y, r.width, r.height,
+			          head->x + r.x, head->y + r.y);
+			stats.pixels += (unsigned long long)r.width * r.height;
+		}
+		XSetClipMask(dc.dpy, dc.gc, None);
+		XSetClipOrigin(dc.dpy, dc.gc, 0, 0);
+		XDestroyRegion(head->damage);
+		head->damage = XCreateRegion();
+	}
+	XDestroyRegion(bounds);
+	XDestroyRegion(band);
+}
+
+/* Copy what has been damaged since the last call, and nothing else. */
+static void
+flush() {
+	for (int i = 0; i < dc.nheads; ++i) {
+		flushhead(&dc.heads[i]);
+	}
+	if (args.latency) {
+		roundtrip();
+		latack(lat.pending);
+	} else {
+		XFlush(dc.dpy);
+	}
+	lat.pending = -1;
+}
+
+static void
+initline(struct line_t *line, const struct linearg_t *arg) {
+	if (!(line->xfont = XftFontOpenName(dc.dpy,dc.screen, arg->font))) {
+		errx(1, "Cannot load font: %s", arg->font);
+	}
+	line->ascent = line->xfont->ascent;
+	line->height = line->xfont->ascent + line->xfont->descent;
+	if (args.debug > 1) {
+		printf("%s:\n", arg->font);
+		printf("  a: %d\n", line->xfont->ascent);
+		printf("  d: %d\n", line->xfont->descent);
+		printf("  h: %d\n", line->height);
+	}
+	line->redraws = 0;
+	line->arg = arg;
+	if (!fmtcompile(&line->fmt, arg->fmt)) {
+		errx(1, "Cannot compile format: %s", arg->fmt);
+	}
+}
+
+static int
+atlasfind(const struct atlas_t *atlas, FcChar32 ucs) {
+	for (int i = 0; i < atlas->n; ++i) {
+		if (atlas->glyph[i].ucs == ucs) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+static void
+atlasadd(struct atlas_t *atlas, XftFont *xfont, const char *s) {
+	int len = strlen(s), n;
+	FcChar32 ucs;
+	for (; len > 0 && (n = FcUtf8ToUcs4((const FcChar8*)s, &ucs, len)) > 0; s += n, len -= n) {
+		if (atlasfind(atlas, ucs) >= 0) {
+			continue;
+		}
+		if (atlas->n == ATLAS_MAX) {
+			return;
+		}
+		atlas->glyph[atlas->n].ucs = ucs;
+		XftTextExtents32(dc.dpy, xfont, &ucs, 1, &atlas->glyph[atlas->n].ext);
+		++atlas->n;
+	}
+}
+
+/* Render every character the format of a line can produce, found by
+ * formatting sample times that step through all values of each field. */
+static struct atlas_t *
+mkatlas(struct line_t *line) {
+	struct atlas_t *atlas;
+	time_t t = time(NULL);
+	struct tm base, tm;
+	struct fmt_t fmt;
+	char buf[FMT_OUTSZ];
+	int w = 0, below = 0;
+
+	if (!(atlas = calloc(1, sizeof(*atlas)))) {
+		err(1, "ERROR: calloc");
+	}
+	/* a copy, so as not to disturb what the line has rendered */
+	if (!fmtcompile(&fmt, line->arg->fmt)) {
+		free(atlas);
+		return NULL;
+	}
+	tzlocal(t, &base);
+	for (int i = 0; i < 60; ++i) {
+		tm = base;
+		tm.tm_sec  = i;
+		tm.tm_min  = i;
+		tm.tm_hour = i % 24;
+		tm.tm_mday = 1 + i % 31;
+		tm.tm_mon  = i % 12;
+		tm.tm_year = base.tm_year + i % 10;
+		tm.tm_wday = i % 7;
+		tm.tm_yday = i * 6;
+		if (fmtrender(&fmt, &tm, i * 16666667L, buf, sizeof(buf))) {
+			atlasadd(atlas, line->xfont, buf);
+		}
+	}
+	fmtfree(&fmt);
+	tzset();
+	for (int i = 0; i < 2; ++i) {
+		if (tzname[i]) {
+			atlasadd(atlas, line->xfont, tzname[i]);
+		}
+	}
+
+	for (int i = 0; i < atlas->n; ++i) {
+		XGlyphInfo *ext = &atlas->glyph[i].ext;
+		atlas->glyph[i].x = w;
+		w += ext->width + 1;
+		if (ext->y > atlas->baseline) {
+			atlas->baseline = ext->y;
+		}
+		if (ext->height - ext->y > below) {
+			below = ext->height - ext->y;
+		}
+	}
+	if (!w || atlas->baseline + below <= 0) {
+		free(atlas);
+		return NULL;
+	}
+
+	atlas->pm = XCreatePixmap(dc.dpy, dc.root, w, atlas->baseline + below, DefaultDepth(dc.dpy, dc.screen));
+	XSetForeground(dc.dpy, dc.gc, dc.bg.pixel);
+	XFillRectangle(dc.dpy, atlas->pm, dc.gc, 0, 0, w, atlas->baseline + below);
+	XftDraw *draw = XftDrawCreate(dc.dpy, atlas->pm, dc.vis, dc.cmap);
+	for (int i = 0; i < atlas->n; ++i) {
+		XftDrawString32(draw, &line->color, line->xfont,
+		                atlas->glyph[i].x + atlas->glyph[i].ext.x, atlas->baseline,
+		                &atlas->glyph[i].ucs, 1);
+	}
+	XftDrawDestroy(draw);
+	if (args.debug > 1) {
+		printf("atlas for '%s': %d glyphs, %dx%d\n", line->arg->fmt, atlas->n, w, atlas->baseline + below);
+	}
+	return atlas;
+}
+
+/* Look up the glyphs of a string and get its extents, as Xft would.
+ * Fails if any character is missing from the atlas, or if the ink boxes
+ * of two glyphs overlap: each box is copied whole, background and all,
+ * so the later one would wipe out part of the earlier. */
+static bool
+atlaslayout(const struct atlas_t *atlas, const char *s, int *idx, int *n, XGlyphInfo *ext) {
+	int len = strlen(s), k, x1 = 0, y1 = 0, x2 = 0, y2 = 0, pen = 0;
+	FcChar32 ucs;
+	for (*n = 0; len > 0; s += k, len -= k) {
+		if ((k = FcUtf8ToUcs4((const FcChar8*)s, &ucs, len)) <= 0 || *n == 64) {
+			return false;
+		}
+		int i = atlasfind(atlas, ucs);
+		if (i < 0) {
+			return false;
+		}
+		const XGlyphInfo *g = &atlas->glyph[i].ext;
+		if (g->width && g->height) {
+			int gx1 = pen - g->x, gy1 = -g->y;
+			int gx2 = gx1 + g->width, gy2 = gy1 + g->height;
+			if (x1 != x2 && gx1 < x2) {
+				return false;
+			}
+			if (x1 == x2) {
+				x1 = gx1; y1 = gy1; x2 = gx2; y2 = gy2;
+			} else {
+				x1 = gx1 < x1 ? gx1 : x1;
+				y1 = gy1 < y1 ? gy1 : y1;
+				x2 = gx2 > x2 ? gx2 : x2;
+				y2 = gy2 > y2 ? gy2 : y2;
+			}
+		}
+		pen += g->xOff;
+		idx[(*n)++] = i;
+	}
+	ext->x = -x1;
+	ext->y = -y1;
+	ext->width = x2 - x1;
+	ext->height = y2 - y1;
+	ext->xOff = pen;
+	ext->yOff = 0;
+	return true;
+}
+
+static bool
+overlaps(const XRectangle *r, int x, int y, int w, int h) {
+	return x < r->x + r->width && x + w > r->x && y < r->y + r->height && y + h > r->y;
+}
+
+/* Glyphs entirely outside clip, unless it is NULL, are skipped. */
+static void
+atlasdraw(const struct atlas_t *atlas, Drawable d, const int *idx, int n, int x, int y, const XRectangle *clip) {
+	for (int i = 0; i < n; ++i) {
+		const XGlyphInfo *g = &atlas->glyph[idx[i]].ext;
+		if (g->width && g->height
+		 && (!clip || overlaps(clip, x - g->x, y - g->y, g->width, g->height))) {
+			XCopyArea(dc.dpy, atlas->pm, d, dc.gc,
+			          atlas->glyph[idx[i]].x, atlas->baseline - g->y, g->width, g->height,
+			          x - g->x, y - g->y);
+		}
+		x += g->xOff;
+	}
+}
+
+/* Ink box, with the pen at x, of the n bytes of s from byte off. */
+static XRectangle
+spanink(const struct line_t *line, const char *s, size_t off, size_t n, int x, int baseline) {
+	XGlyphInfo pre, ext;
+	XftTextExtentsUtf8(dc.dpy, line->xfont, (const FcChar8*)s, off, &pre);
+	XftTextExtentsUtf8(dc.dpy, line->xfont, (const FcChar8*)s + off, n, &ext);
+	return (XRectangle){ x + pre.xOff - ext.x, baseline - ext.y, ext.width, ext.height };
+}
+
+/* Ink box of the characters that differ between old and buf, as old and
+ * new text, for when nothing else on the line moves. */
+static XRectangle
+changedink(const struct line_t *line, const char *old, const char *buf, int x, int baseline) {
+	size_t olen = strlen(old), len = strlen(buf), pre = 0, suf = 0;
+	while (pre < olen && pre < len && old[pre] == buf[pre]) {
+		++pre;
+	}
+	while (pre && (buf[pre] & 0xc0) == 0x80) {
+		--pre;
+	}
+	while (suf < olen - pre && suf < len - pre && old[olen - 1 - suf] == buf[len - 1 - suf]) {
+		++suf;
+	}
+	while (suf && (buf[len - suf] & 0xc0) == 0x80) {
+		--suf;
+	}
+	XRectangle box = spanink(line, old, pre, olen - pre - suf, x, baseline);
+	XRectangle ink = spanink(line, buf, pre, len - pre - suf, x, baseline);
+	unionrect(&box, &ink);
+	return box;
+}
+
+/* Draw the formatted text of a line, measured as ext, on one head. */
+static void
+drawplace(struct head_t *head, const struct line_t *line, const XGlyphInfo *ext,
+          bool atlas, const int *idx, int n) {
+	struct place_t *place = placeof(head, line);
+	const char *buf = line->buf;
+	size_t len = strlen(buf);
+	int w = ext->xOff;
+	int x = (head->w - w) / 2 - head->band.x;
+	int baseline = place->y + line->ascent;
+
+	if (!place->warned && w > head->w) {
+		place->warned = true;
+		warnx("Excessive width %d for '%s' using font %s", w, buf, line->arg->font);
+	}
+
+	/* only the pixels inked by the old or the new text can change */
+	XRectangle ink = { x - ext->x, baseline - ext->y, ext->width, ext->height };
+	XRectangle box = place->ink;
+	/* with the same advance, only the characters that differ, such as
+	 * the fraction of a second, are redrawn */
+	bool partial = place->ink.width && x == place->x && w == place->advance;
+	if (partial) {
+		box = changedink(line, place->buf, buf, x, baseline);
+	} else {
+		unionrect(&box, &ink);
+	}
+
+	if (box.width && box.height) {
+		if (!args.threads) {
+			XSetForeground(dc.dpy, dc.gc, args.debug > 2 ? 0x302030 : dc.bg.pixel);
+			XFillRectangle(dc.dpy, head->da, dc.gc, box.x, box.y, box.width, box.height);
+		}
+		unionrect(&place->damage, &box);
+	}
+	stats.inked += (unsigned long long)box.width * box.height;
+	stats.banded += (unsigned long long)head->w * line->height;
+
+	if (partial && (!box.width || !box.height)) {
+		;
+	} else if (args.threads) {
+		/* for swdraw(); the box holds all the ink there is to draw */
+		if (box.width && box.height) {
+			head->ops[head->nops++] = (struct swop_t){ line, box, x, baseline };
+		}
+	} else if (atlas) {
+		if (partial) {
+			XSetClipRectangles(dc.dpy, dc.gc, 0, 0, &box, 1, Unsorted);
+		}
+		atlasdraw(line->atlas, head->da, idx, n, x, baseline, partial ? &box : NULL);
+		if (partial) {
+			XSetClipMask(dc.dpy, dc.gc, None);
+		}
+	} else {
+		/* the whole line, clipped, for glyphs that reach into the box */
+		if (partial) {
+			XftDrawSetClipRectangles(head->draw, 0, 0, &box, 1);
+		}
+		XftDrawStringUtf8(head->draw,
+		                  &line->color,
+		                  line->xfont,
+		                  x,
+		                  baseline,
+		                  (XftChar8*)buf,
+		                  len);
+		if (partial) {
+			XftDrawSetClip(head->draw, NULL);
+		}
+	}
+	strncpy(place->buf, buf, sizeof(place->buf));
+	place->ink = ink;
+	place->x = x;
+	place->advance = w;
+}
+
+/* Extents of the formatted text, and its glyphs if it can be drawn
+ * from the atlas, which is then returned true. */
+static bool
+measure(struct line_t *line, XGlyphInfo *ext, int *idx, int *n) {
+	if (args.threads && (line->nridx = rlayout(&line->rfont, dc.dpy, line->xfont, line->buf,
+	                                           line->ridx, FMT_OUTSZ)) < 0) {
+		line->nridx = 0;
+		warnx("Cannot rasterize '%s'", line->buf);
+	}
+	/* non-monospaced */
+	if (line->atlas && atlaslayout(line->atlas, line->buf, idx, n, ext)) {
+		return true;
+	}
+	XftTextExtentsUtf8(dc.dpy, line->xfont, (FcChar8*)line->buf, strlen(line->buf), ext);
+	return false;
+}
+
+/* Software drawing of one head, on a worker thread. */
+static void
+swrender(void *arg) {
+	struct head_t *head = arg;
+	if (!head->nops) {
+		return;
+	}
+	for (int i = 0; i < head->nops; ++i) {
+		const struct swop_t *op = &head->ops[i];
+		rfill(&head->img, &op->box, dc.bg.pixel);
+		rdraw(&head->img, &op->box, &op->line->rfont, op->line->ridx, op->line->nridx,
+		      op->x, op->baseline, op->line->color.pixel);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &head->rendered);
+}
+
+static Bool
+isshmdone(Display *dpy, XEvent *ev, XPointer arg) {
+	return ev->type == dc.shmevbase + ShmCompletion;
+}
+
+/* Shared images are not to be drawn into before the server has read
+ * them. It normally has, and said so, long before the next frame. */
+static void
+shmwait() {
+	XEvent ev;
+	while (dc.shmpending && XCheckIfEvent(dc.dpy, &ev, isshmdone, NULL)) {
+		--dc.shmpending;
+	}
+	if (dc.shmpending) {
+		++stats.shmwaits;
+	}
+	for (; dc.shmpending; --dc.shmpending) {
+		XIfEvent(dc.dpy, &ev, isshmdone, NULL);
+	}
+}
+
+/* Draw what drawplace() left for software on all heads at once, then put
+ * the results into the pixmaps from this thread, heads back to back. */
+static void
+swdraw() {
+	struct timespec t0, t1, t2, first = { 0 }, last = { 0 };
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	shmwait();
+	poolrun(swrender, dc.heads, sizeof(*dc.heads), dc.nheads);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	for (int i = 0; i < dc.nheads; ++i) {
+		struct head_t *head = &dc.heads[i];
+		if (!head->nops) {
+			continue;
+		}
+		if (!first.tv_sec || nsec(&head->rendered, &first) > 0) {
+			first = head->rendered;
+		}
+		if (!last.tv_sec || nsec(&last, &head->rendered) > 0) {
+			last = head->rendered;
+		}
+		for (int j = 0; j < head->nops; ++j) {
+			XRectangle r = head->ops[j].box;
+			if (!cliprect(&r, head->band.width, head->band.height)) {
+				continue;
+			}
+			if (head->shm.shmaddr) {
+				XShmPutImage(dc.dpy, head->da, dc.gc, head->ximg, r.x, r.y, r.x, r.y, r.width, r.height, True);
+				++dc.shmpending;
+			} else {
+				XPutImage(dc.dpy, head->da, dc.gc, head->ximg, r.x, r.y, r.x, r.y, r.width, r.height);
+			}
+		}
+		head->nops = 0;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t2);
+	if (first.tv_sec) {
+		long long skew = nsec(&first, &last);
+		++stats.swframes;
+		stats.swrenderns += nsec(&t0, &t1);
+		stats.swsubmitns += nsec(&t1, &t2);
+		stats.swskewns += skew;
+		if (skew > stats.maxswskewns) {
+			stats.maxswskewns = skew;
+		}
+	}
+}
+
+/* Bytes this process has written so far, the X connection included,
+ * or 0 if the kernel does not say. */
+static unsigned long long
+written() {
+	unsigned long long n = 0;
+	char line[64];
+	FILE *f = fopen("/proc/self/io", "r");
+	if (!f) {
+		return 0;
+	}
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "wchar: %llu", &n) == 1) {
+			break;
+		}
+	}
+	fclose(f);
+	return n;
+}
+
+/* Format a line once, and draw it on every head. */
+static bool
+drawtext(struct line_t *line, struct tm *tmp, long ns) {
+	if (!fmtrender(&line->fmt, tmp, ns, line->buf, sizeof(line->buf))) {
+		/* no need to redraw */
+		return false;
+	}
+	struct timespec t0, t1;
+	unsigned long long sent = 0;
+	if (args.debug > 1) {
+		/* send what is pending so only this text's requests are counted */
+		XFlush(dc.dpy);
+		sent = written();
+	}
+	unsigned long req = NextRequest(dc.dpy);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	XGlyphInfo ext;
+	int idx[64], n;
+	bool atlas = measure(line, &ext, idx, &n);
+	for (int i = 0; i < dc.nheads; ++i) {
+		drawplace(&dc.heads[i], line, &ext, atlas, idx, n);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	stats.renderns += nsec(&t0, &t1);
+	stats.requests += NextRequest(dc.dpy) - req;
+	if (args.debug > 1) {
+		XFlush(dc.dpy);
+		stats.reqbytes += written() - sent;
+	}
+	++stats.updates;
+	++line->redraws;
+	return true;
+}
+
+static bool
+draw(const struct timespec *ts) {
+	struct tm tm;
+	bool dirty = false;
+	if (!tzlocal(ts->tv_sec, &tm)) {
+		err(1, "ERROR: localtime");
+	}
+	if (drawtext(&dc.text1, &tm, ts->tv_nsec)) {
+		dirty = true;
+	}
+	if (drawtext(&dc.text2, &tm, ts->tv_nsec)) {
+		dirty = true;
+	}
+	if (dirty && args.threads) {
+		swdraw();
+	}
+	if (dirty) {
+		++stats.frames;
+	}
+	return dirty;
+}
+
+/* Draw the text as it is now on one head, as when it is new. */
+static void
+drawhead(struct head_t *head) {
+	struct line_t *lines[] = { &dc.text1, &dc.text2 };
+	for (int i = 0; i < 2; ++i) {
+		XGlyphInfo ext;
+		int idx[64], n;
+		bool atlas = measure(lines[i], &ext, idx, &n);
+		drawplace(head, lines[i], &ext, atlas, idx, n);
+	}
+}
+
+/* Take the heads to draw on: all of them with -a, otherwise the one given
+ * with -s, or the first at x 0, or just the first. A new array replaces
+ * dc.heads, which the caller frees. */
+static void
+usescreen(const XineramaScreenInfo *info, int n) {
+	int first = 0, last;
+	if (n <= 0) {
+		return;
+	}
+	if (args.allheads) {
+		last = n;
+	} else {
+		if (args.screen != -1) {
+			if (args.screen >= n && !dc.heads) {
+				errx(1, "%d exceeds the number of screens (%d)", args.screen, n);
+			}
+			/* unless it has gone away since */
+			first = args.screen < n ? args.screen : 0;
+		} else {
+			for (int i = n - 1; i >= 0; --i) {
+				if (info[i].x_org == 0) {
+					first = i;
+				}
+			}
+		}
+		last = first + 1;
+	}
+	if (!(dc.heads = calloc(last - first, sizeof(*dc.heads)))) {
+		err(1, "ERROR: calloc");
+	}
+	dc.nheads = 0;
+	for (int i = first; i < last; ++i) {
+		struct head_t *head = &dc.heads[dc.nheads];
+		*head = (struct head_t){ .x = info[i].x_org, .y = info[i].y_org,
+		                         .w = info[i].width, .h = info[i].height };
+		/* cloned outputs are one head */
+		bool clone = false;
+		for (int j = 0; j < dc.nheads; ++j) {
+			const struct head_t *h = &dc.heads[j];
+			clone |= h->x == head->x && h->y == head->y && h->w == head->w && h->h == head->h;
+		}
+		if (!clone) {
+			++dc.nheads;
+		}
+	}
+}
+
+/* Heads from Xinerama, or the whole screen when it is inactive. */
+static void
+queryheads() {
+	XineramaScreenInfo *info;
+	int n = 0;
+	if (XineramaIsActive(dc.dpy) && (info = XineramaQueryScreens(dc.dpy, &n))) {
+		if (n > 0) {
+			usescreen(info, n);
+		}
+		XFree(info);
+	}
+	if (n <= 0) {
+		XineramaScreenInfo whole = { 0, 0, 0, DisplayWidth(dc.dpy, dc.screen), DisplayHeight(dc.dpy, dc.screen) };
+		usescreen(&whole, 1);
+	}
+}
+
+#ifdef USE_XCB
+#define BACKEND "xcb"
+
+static void
+xftcolor(const XColor *xc, XftColor *color) {
+	color->pixel = xc->pixel;
+	color->color.red = xc->red;
+	color->color.green = xc->green;
+	color->color.blue = xc->blue;
+	color->color.alpha = 0xffff;
+}
+
+/* Send every startup query before waiting for any reply, so that they
+ * share round-trips instead of paying one each. */
+static void
+queryserver() {
+	xcb_connection_t *c = XGetXCBConnection(dc.dpy);
+	const char *names[] = { args.background, args.text1.color, args.text2.color };
+	XColor xc[3];
+	bool named[3];
+	union {
+		xcb_alloc_color_cookie_t rgb;
+		xcb_alloc_named_color_cookie_t named;
+	} cookie[3];
+	xcb_xinerama_query_screens_cookie_t screens = { 0 };
+	const xcb_query_extension_reply_t *ext;
+
+	xcb_prefetch_extension_data(c, &xcb_xinerama_id);
+	for (int i = 0; i < 3; ++i) {
+		/* the server knows names, but specs like #303030 or rgb:30/30/30
+		 * are for the client to parse, which Xlib does without a
+		 * round-trip and as the Xlib build does */
+		if ((named[i] = names[i][0] != '#' && !strchr(names[i], ':'))) {
+			cookie[i].named = xcb_alloc_named_color(c, dc.cmap, strlen(names[i]), names[i]);
+		} else if (XParseColor(dc.dpy, dc.cmap, names[i], &xc[i])) {
+			cookie[i].rgb = xcb_alloc_color(c, dc.cmap, xc[i].red, xc[i].green, xc[i].blue);
+		} else {
+			errx(1, "Cannot load color: %s", names[i]);
+		}
+	}
+	if ((ext = xcb_get_extension_data(c, &xcb_xinerama_id)) && ext->present) {
+		screens = xcb_xinerama_query_screens(c);
+	}
+
+	for (int i = 0; i < 3; ++i) {
+		if (named[i]) {
+			xcb_alloc_named_color_reply_t *r;
+			if (!(r = xcb_alloc_named_color_reply(c, cookie[i].named, NULL))) {
+				errx(1, "Cannot load color: %s", names[i]);
+			}
+			xc[i].pixel = r->pixel;
+			xc[i].red = r->visual_red;
+			xc[i].green = r->visual_green;
+			xc[i].blue = r->visual_blue;
+			free(r);
+		} else {
+			xcb_alloc_color_reply_t *r;
+			if (!(r = xcb_alloc_color_reply(c, cookie[i].rgb, NULL))) {
+				errx(1, "Cannot load color: %s", names[i]);
+			}
+			xc[i].pixel = r->pixel;
+			xc[i].red = r->red;
+			xc[i].green = r->green;
+			xc[i].blue = r->blue;
+			free(r);
+		}
+	}
+	dc.bg = xc[0];
+	xftcolor(&xc[1], &dc.text1.color);
+	xftcolor(&xc[2], &dc.text2.color);
+
+	if (screens.sequence) {
+		xcb_xinerama_query_screens_reply_t *r;
+		if ((r = xcb_xinerama_query_screens_reply(c, screens, NULL))) {
+			int n = xcb_xinerama_query_screens_screen_info_length(r);
+			xcb_xinerama_screen_info_t *si = xcb_xinerama_query_screens_screen_info(r);
+			XineramaScreenInfo *info = calloc(n > 0 ? n : 1, sizeof(*info));
+			if (!info) {
+				err(1, "ERROR: calloc");
+			}
+			for (int i = 0; i < n; ++i) {
+				info[i].screen_number = i;
+				info[i].x_org = si[i].x_org;
+				info[i].y_org = si[i].y_org;
+				info[i].width = si[i].width;
+				info[i].height = si[i].height;
+			}
+			usescreen(info, n);
+			free(info);
+			free(r);
+		}
+	}
+}
+#else
+#define BACKEND "xlib"
+
+static void
+querycolor(const char *name, XftColor *color) {
+	if (!XftColorAllocName(dc.dpy, dc.vis, dc.cmap, name, color)) {
+		errx(1, "Cannot load color: %s", name);
+	}
+}
+
+static void
+queryserver() {
+	queryheads();
+	if (!XAllocNamedColor(dc.dpy, dc.cmap, args.background, &dc.bg, &dc.bg)) {
+		errx(1, "Cannot load color: %s", args.background);
+	}
+	querycolor(args.text1.color, &dc.text1.color);
+	querycolor(args.text2.color, &dc.text2.color);
+}
+#endif
+
+/* Requests are not waited for, so errors arrive here whenever they do. */
+static int
+xerror(Display *dpy, XErrorEvent *ev) {
+	char msg[128];
+	XGetErrorText(dpy, ev->error_code, msg, sizeof(msg));
+	warnx("X error: %s (request %d.%d, serial %lu)",
+	      msg, ev->request_code, ev->minor_code, ev->serial);
+	return 0;
+}
+
+/* Place the lines on a head and size its pixmap to hold just them.
+ * Line positions are kept relative to the pixmap. */
+static void
+layout(struct head_t *head) {
+	int y1 = (head->h - dc.text1.height - dc.text2.height) / 2 + args.text1.dy;
+	int y2 = y1 + dc.text1.height + args.text2.dy;
+	int top = y1 < y2 ? y1 : y2;
+	int bottom = y1 + dc.text1.height > y2 + dc.text2.height ? y1 + dc.text1.height : y2 + dc.text2.height;
+
+	top = top < 0 ? 0 : top;
+	bottom = bottom > head->h ? head->h : bottom;
+	if (bottom <= top) {
+		top = 0;
+		bottom = 1;
+	}
+	if (args.rootbg) {
+		/* a background pixmap tiles from the root origin */
+		head->band = (XRectangle){ -head->x, -head->y,
+		                           DisplayWidth(dc.dpy, dc.screen),
+		                           DisplayHeight(dc.dpy, dc.screen) };
+	} else {
+		head->band = (XRectangle){ 0, top, head->w, bottom - top };
+	}
+	head->text1.y = y1 - head->band.y;
+	head->text2.y = y2 - head->band.y;
+	if (args.debug > 1) {
+		printf("band: y=%d h=%d\n", head->band.y, head->band.height);
+	}
+}
+
+/* Each head gets a pixmap of its own, except as the root background,
+ * where all of them draw into the one that covers the root window. */
+static void
+mkpixmap(struct head_t *head) {
+	if (args.rootbg && head != dc.heads) {
+		head->da = dc.heads->da;
+		head->draw = dc.heads->draw;
+		return;
+	}
+	head->da = XCreatePixmap(dc.dpy, dc.root, head->band.width, head->band.height, DefaultDepth(dc.dpy, dc.screen));
+	/* lives as long as the pixmap, so the Picture behind it is made once */
+	if (!(head->draw = XftDrawCreate(dc.dpy, head->da, dc.vis, dc.cmap))) {
+		errx(1, "Cannot create XftDraw");
+	}
+	XSetForeground(dc.dpy, dc.gc, dc.bg.pixel);
+	XFillRectangle(dc.dpy, head->da, dc.gc, 0, 0, head->band.width, head->band.height);
+}
+
+/* Software drawing needs pixels of 32 bits with a byte per channel. */
+static bool
+swusable() {
+	unsigned long masks[] = { dc.vis->red_mask, dc.vis->green_mask, dc.vis->blue_mask };
+	int n;
+	bool ok = false;
+	XPixmapFormatValues *pf = XListPixmapFormats(dc.dpy, &n);
+	for (int i = 0; pf && i < n; ++i) {
+		if (pf[i].depth == DefaultDepth(dc.dpy, dc.screen)) {
+			ok = pf[i].bits_per_pixel == 32;
+		}
+	}
+	if (pf) {
+		XFree(pf);
+	}
+	for (int i = 0; i < 3; ++i) {
+		ok &= masks[i] == 0xff || masks[i] == 0xff00 || masks[i] == 0xff0000 || masks[i] == 0xff000000;
+	}
+	return ok;
+}
+
+static bool shmfailed;
+
+static int
+shmxerror(Display *dpy, XErrorEvent *ev) {
+	shmfailed = true;
+	return 0;
+}
+
+/* An image in memory shared with the server, which cannot attach it when
+ * it is on another machine. */
+static bool
+mkshmimage(struct head_t *head) {
+	int (*handler)(Display*, XErrorEvent*);
+	XImage *ximg;
+	if (!(ximg = XShmCreateImage(dc.dpy, dc.vis, DefaultDepth(dc.dpy, dc.screen), ZPixmap, NULL,
+	                             &head->shm, head->band.width, head->band.height))) {
+		return false;
+	}
+	head->shm.shmid = shmget(IPC_PRIVATE, (size_t)ximg->bytes_per_line * ximg->height, IPC_CREAT | 0600);
+	if (head->shm.shmid < 0) {
+		XDestroyImage(ximg);
+		return false;
+	}
+	head->shm.shmaddr = shmat(head->shm.shmid, NULL, 0);
+	/* either way, the segment goes once both sides have detached */
+	shmctl(head->shm.shmid, IPC_RMID, NULL);
+	if (head->shm.shmaddr == (char*)-1) {
+		head->shm.shmaddr = NULL;
+		XDestroyImage(ximg);
+		return false;
+	}
+	ximg->data = head->shm.shmaddr;
+	head->shm.readOnly = True;
+	shmfailed = false;
+	handler = XSetErrorHandler(shmxerror);
+	XShmAttach(dc.dpy, &head->shm);
+	XSync(dc.dpy, False);
+	XSetErrorHandler(handler);
+	if (shmfailed) {
+		shmdt(head->shm.shmaddr);
+		head->shm.shmaddr = NULL;
+		ximg->data = NULL;
+		XDestroyImage(ximg);
+		return false;
+	}
+	head->ximg = ximg;
+	return true;
+}
+
+/* The client-side copy of a head's pixmap that software draws into. */
+static void
+mkimage(struct head_t *head) {
+	union { uint32_t u; unsigned char c; } endian = { 1 };
+	uint32_t *px;
+	if (args.shm && !mkshmimage(head)) {
+		warnx("WARNING: MIT-SHM unusable, using XPutImage");
+		args.shm = false;
+	}
+	if (head->ximg) {
+		/* in the server's byte order, which is the native one locally */
+		px = (uint32_t*)head->ximg->data;
+	} else {
+		if (!(px = malloc((size_t)head->band.width * head->band.height * sizeof(*px)))
+		 || !(head->ximg = XCreateImage(dc.dpy, dc.vis, DefaultDepth(dc.dpy, dc.screen), ZPixmap, 0,
+		                                (char*)px, head->band.width, head->band.height, 32, 0))) {
+			errx(1, "Cannot create image");
+		}
+		/* pixels are written as native integers; Xlib swaps them if need be */
+		head->ximg->byte_order = endian.c ? LSBFirst : MSBFirst;
+	}
+	head->img = (struct rimage_t){ px, head->band.width, head->band.height, head->ximg->bytes_per_line / 4 };
+	rfill(&head->img, &(XRectangle){ 0, 0, head->band.width, head->band.height }, dc.bg.pixel);
+}
+
+static void
+freeimage(struct head_t *head) {
+	if (head->shm.shmaddr) {
+		XShmDetach(dc.dpy, &head->shm);
+		shmdt(head->shm.shmaddr);
+		/* not XDestroyImage's to free */
+		head->ximg->data = NULL;
+	}
+	XDestroyImage(head->ximg);
+	head->ximg = NULL;
+}
+
+/* The second pixmap that precise ticks render into, starting out as a
+ * copy of the first. */
+static void
+mkback(struct head_t *head) {
+	head->back = XCreatePixmap(dc.dpy, dc.root, head->band.width, head->band.height, DefaultDepth(dc.dpy, dc.screen));
+	if (!(head->backdraw = XftDrawCreate(dc.dpy, head->back, dc.vis, dc.cmap))) {
+		errx(1, "Cannot create XftDraw");
+	}
+	XCopyArea(dc.dpy, head->da, head->back, dc.gc, 0, 0, head->band.width, head->band.height, 0, 0);
+}
+
+/* Make the pixmap the root background, and tell other clients about it
+ * the way xsetroot-alikes do. None restores the default background.
+ * ESETROOT_PMAP_ID tells the next setter that it may kill the owner of
+ * the pixmap, so it is only set for one that is retained.
+ * Returns the pixmap that a previous client left as ESETROOT_PMAP_ID. */
+static Pixmap
+setrootpmap(Pixmap pm, bool retained) {
+	char xrootpmap[] = "_XROOTPMAP_ID", esetroot[] = "ESETROOT_PMAP_ID";
+	char *names[] = { xrootpmap, esetroot };
+	Atom atoms[2], type;
+	int format;
+	unsigned long n, after;
+	unsigned char *data = NULL;
+	Pixmap prev = None;
+
+	XInternAtoms(dc.dpy, names, 2, False, atoms);
+	if (XGetWindowProperty(dc.dpy, dc.root, atoms[1], 0, 1, False, XA_PIXMAP,
+	                       &type, &format, &n, &after, &data) == Success
+	 && type == XA_PIXMAP && format == 32 && n == 1) {
+		prev = *(Pixmap*)data;
+	}
+	if (data) {
+		XFree(data);
+	}
+	for (int i = 0; i < 2; ++i) {
+		if (pm == None || (i == 1 && !retained)) {
+			XDeleteProperty(dc.dpy, dc.root, atoms[i]);
+		} else {
+			XChangeProperty(dc.dpy, dc.root, atoms[i], XA_PIXMAP, 32,
+			                PropModeReplace, (unsigned char*)&pm, 1);
+		}
+	}
+	XSetWindowBackgroundPixmap(dc.dpy, dc.root, pm);
+	XClearWindow(dc.dpy, dc.root);
+	return prev;
+}
+
+/* Server-side pixmap memory charged to this client. */
+static void
+reportpixmaps() {
+	int evbase, errbase;
+	unsigned long bytes;
+	if (XResQueryExtension(dc.dpy, &evbase, &errbase)
+	 && XResQueryClientPixmapBytes(dc.dpy, dc.heads->da, &bytes)) {
+		printf("pixmap memory: %lu bytes\n", bytes);
+	}
+}
+
+static void
+reportusage() {
+	struct rusage ru;
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	if (!getrusage(RUSAGE_SELF, &ru)) {
+		printf("run time: %lldus, cpu: %ldus, max rss: %ldkB\n",
+		       nsec(&start, &t) / 1000,
+		       (long)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000
+		       + ru.ru_utime.tv_usec + ru.ru_stime.tv_usec,
+		       ru.ru_maxrss);
+	}
+}
+
+static void
+setup() {
+	if (!(dc.dpy = XOpenDisplay(NULL))) {
+		errx(1, "Cannot open display");
+	}
+	XSetErrorHandler(xerror);
+	dc.screen = DefaultScreen(dc.dpy);
+	dc.root = RootWindow(dc.dpy, dc.screen);
+	dc.cmap = DefaultColormap(dc.dpy, dc.screen);
+	dc.vis = DefaultVisual(dc.dpy, dc.screen);
+	queryserver();
+	if (!dc.nheads) {
+		XineramaScreenInfo whole = { 0, 0, 0, DisplayWidth(dc.dpy, dc.screen), DisplayHeight(dc.dpy, dc.screen) };
+		usescreen(&whole, 1);
+	}
+	if (args.debug > 1) {
+		for (int i = 0; i < dc.nheads; ++i) {
+			const struct head_t *head = &dc.heads[i];
+			printf("x=%d y=%d w=%d h=%d\n", head->x, head->y, head->w, head->h);
+		}
+	}
+	XGCValues gcv = { 0 };
+	dc.gc = XCreateGC(dc.dpy, dc.root, GCGraphicsExposures, &gcv);
+
+	initline(&dc.text1, &args.text1);
+	initline(&dc.text2, &args.text2);
+	if (args.atlas) {
+		dc.text1.atlas = mkatlas(&dc.text1);
+	}
+	if (args.threads && !swusable()) {
+		warnx("WARNING: visual unfit for software drawing, using Xft");
+		args.threads = 0;
+	}
+	if (args.shm && args.threads && !XShmQueryExtension(dc.dpy)) {
+		warnx("WARNING: no MIT-SHM, using XPutImage");
+	}
+	args.shm = args.shm && args.threads && XShmQueryExtension(dc.dpy);
+	if (args.shm) {
+		dc.shmevbase = XShmGetEventBase(dc.dpy);
+	}
+	if (args.threads) {
+		blendinit(args.gamma);
+	}
+	for (int i = 0; i < dc.nheads; ++i) {
+		layout(&dc.heads[i]);
+		mkpixmap(&dc.heads[i]);
+		if (args.threads) {
+			mkimage(&dc.heads[i]);
+		}
+		dc.heads[i].damage = XCreateRegion();
+	}
 
-struct line_t {
-	char buf[64];
-	int y;
-	int ascent;
-	int height;
-	bool warned;
-	XftFont *xfont;
-	XftColor color;
-	const struct linearg_t *arg;
-};
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	if (args.rootbg) {
+		/* exposures are the server's business */
+		draw(&now);
+		dc.prevpm = setrootpmap(dc.heads->da, args.oneshot);
+		if (!args.oneshot && dc.prevpm != None) {
+			/* with its property gone, nobody else would free it */
+			XKillClient(dc.dpy, dc.prevpm);
+			dc.prevpm = None;
+		}
+	} else {
+		XSelectInput(dc.dpy, dc.root, ExposureMask);
+		damage(0, 0, DisplayWidth(dc.dpy, dc.screen), DisplayHeight(dc.dpy, dc.screen));
+		draw(&now);
+	}
+	flush();
 
-static struct {
-	XColor bg;
-	Display *dpy;
-	int screen;
-	Window root;
-	int x, y;
-	int w, h;
-	GC gc;
-	Drawable da;
-	Colormap cmap;
-	Visual *vis;
-	struct line_t text1, text2;
-} dc;
+	if (args.debug > 1) {
+		struct timespec t;
+		roundtrip();
+		clock_gettime(CLOCK_MONOTONIC, &t);
+		printf("first frame: %lldus on %d heads (%s)\n", nsec(&start, &t) / 1000, dc.nheads, BACKEND);
+		reportpixmaps();
+		reportusage();
+	}
+}
 
-static int
-textnw(XftFont *xfont, const char *text, int len) {
-        XGlyphInfo ext;
-        XftTextExtentsUtf8(dc.dpy, xfont, (FcChar8*)text, len, &ext);
-        return ext.xOff;
+/* Finest unit of time that a compiled format can show. */
+static enum unit_t
+fmtunit(const struct fmt_t *fmt) {
+	if (fmt->deps & TM_SEC) {
+		return UNIT_SECOND;
+	} else if (fmt->deps & TM_MIN) {
+		return UNIT_MINUTE;
+	} else if (fmt->deps & (TM_HOUR | TM_ZONE)) {
+		return UNIT_HOUR;
+	}
+	return UNIT_DAY;
+}
+
+static time_t
+uptime() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec;
+}
+
+/* CPU time of the server, in nanoseconds, if it is local and so the peer
+ * of our connection; otherwise -1. It includes all the other clients. */
+static long long
+servercpu() {
+	/* struct ucred, which needs _GNU_SOURCE */
+	struct {
+		pid_t pid;
+		uid_t uid;
+		gid_t gid;
+	} cred;
+	socklen_t len = sizeof(cred);
+	unsigned long ut, st;
+	char path[64], buf[1024], *p;
+	size_t n;
+	FILE *f;
+
+	if (getsockopt(ConnectionNumber(dc.dpy), SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0 || cred.pid <= 0) {
+		return -1;
+	}
+	snprintf(path, sizeof(path), "/proc/%d/stat", (int)cred.pid);
+	if (!(f = fopen(path, "r"))) {
+		return -1;
+	}
+	n = fread(buf, 1, sizeof(buf) - 1, f);
+	fclose(f);
+	buf[n] = '\0';
+	/* the command name may hold anything, so count fields from its end */
+	if (!(p = strrchr(buf, ')'))
+	 || sscanf(p + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &ut, &st) != 2) {
+		return -1;
+	}
+	return (long long)(ut + st) * 1000000000LL / sysconf(_SC_CLK_TCK);
 }
 
 static void
-initline(struct line_t *line, const struct linearg_t *arg) {
-	if (!(line->xfont = XftFontOpenName(dc.dpy,dc.screen, arg->font))) {
-		errx(1, "Cannot load font: %s", arg->font);
+initsched() {
+	struct timespec now;
+	enum unit_t u1 = fmtunit(&dc.text1.fmt);
+	enum unit_t u2 = fmtunit(&dc.text2.fmt);
+	enum unit_t unit = u1 < u2 ? u1 : u2;
+	int digits = dc.text1.fmt.digits > dc.text2.fmt.digits ? dc.text1.fmt.digits : dc.text2.fmt.digits;
+	int rate;
+	/* as fast as the finest fraction shown changes, up to the limit */
+	for (rate = 1; digits-- > 0 && rate < args.fps; ) {
+		rate *= 10;
+	}
+	rate = rate > args.fps ? args.fps : rate;
+	/* with slack, the timer is only a backstop for the epoll timeout;
+	 * precise ticks wake early enough to render ahead of time */
+	if ((sched.fd = timerinit(NULL, unit, rate,
+	                          args.slack * 1000000L - (args.precise ? PRECISE_LEADNS : 0))) < 0) {
+		err(1, "ERROR: timerfd_create");
 	}
-	line->ascent = line->xfont->ascent;
-	line->height = line->xfont->ascent + line->xfont->descent;
 	if (args.debug > 1) {
-		printf("%s:\n", arg->font);
-		printf("  a: %d\n", line->xfont->ascent);
-		printf("  d: %d\n", line->xfont->descent);
-		printf("  h: %d\n", line->height);
+		if (rate > 1) {
+			printf("update rate: %dHz\n", rate);
+		} else {
+			printf("update interval: %ds\n", unit);
+		}
 	}
-	if (!XftColorAllocName(dc.dpy, dc.vis, dc.cmap, arg->color, &line->color)) {
-		errx(1, "Cannot load color: %s", arg->color);
+	stats.since = uptime();
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &stats.cpu);
+	stats.servercpu = servercpu();
+	timernow(&now);
+	if (timerarm(&now) < 0) {
+		err(1, "ERROR: timerfd_settime");
 	}
-	line->warned = false;
-	line->arg = arg;
 }
 
-static bool
-drawtext(struct line_t *line, struct tm *tmp, bool force) {
-	char buf[64] = { 0 };
-	if (!strftime(buf, sizeof(buf), line->arg->fmt, tmp)) {
-		err(1, "ERROR strftime %s", line->arg->fmt);
-	}
-	if (!force && !strcmp(buf, line->buf)) {
-		/* no need to redraw */
-		return false;
+static void
+reportsw() {
+	if (stats.swframes) {
+		printf("software: render %lldus, submit %lldus, head skew %lldus mean, %lldus max (%d heads, %d threads, %s, %s)\n",
+		       stats.swrenderns / 1000 / stats.swframes, stats.swsubmitns / 1000 / stats.swframes,
+		       stats.swskewns / 1000 / stats.swframes, stats.maxswskewns / 1000,
+		       dc.nheads, args.threads, blendname(), args.shm ? "MIT-SHM" : "XPutImage");
+		if (stats.shmwaits) {
+			printf("waits for the server to read shared images: %lu\n", stats.shmwaits);
+		}
 	}
-	/* non-monospaced */
-	size_t len = strlen(buf);
-	int w = textnw(line->xfont, buf, len);
+}
 
-	if (!line->warned && w > dc.w) {
-		line->warned = true;
-		warnx("Excessive width %d for '%s' using font %s", w, buf, line->arg->font);
+/* CPU time of the whole process, and of a local server, for each frame
+ * that changed the display. */
+static void
+reportframes() {
+	struct timespec cpu;
+	long long server = servercpu();
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu);
+	if (stats.frames) {
+		printf("cpu per frame: %lldus over %lu frames\n",
+		       nsec(&stats.cpu, &cpu) / 1000 / stats.frames, stats.frames);
+		if (server >= 0 && stats.servercpu >= 0) {
+			printf("server cpu per frame: %lldus\n", (server - stats.servercpu) / 1000 / stats.frames);
+		}
 	}
+}
 
-	XSetForeground(dc.dpy, dc.gc, args.debug > 2 ? 0x302030 : dc.bg.pixel);
-	XFillRectangle(dc.dpy, dc.da, dc.gc, dc.x, line->y, dc.w, line->height);
+static int
+cmpll(const void *a, const void *b) {
+	long long x = *(const long long *)a, y = *(const long long *)b;
+	return x < y ? -1 : x > y;
+}
 
-	XftDraw *draw = XftDrawCreate(dc.dpy, dc.da, dc.vis, dc.cmap);
+static void
+latstage(const char *name, long long *v, int n) {
+	if (!n) {
+		return;
+	}
+	qsort(v, n, sizeof(*v), cmpll);
+	printf("latency %s: p50 %lldus, p99 %lldus, max %lldus\n", name,
+	       v[(n - 1) * 50 / 100] / 1000, v[(n - 1) * 99 / 100] / 1000, v[n - 1] / 1000);
+}
 
-	XftDrawStringUtf8(draw,
-	                  &line->color,
-	                  line->xfont,
-	                  (dc.w - w) / 2,
-	                  line->y + line->ascent,
-	                  (XftChar8*)buf,
-	                  len);
-	XftDrawDestroy(draw);
-	strncpy(line->buf, buf, sizeof(line->buf));
-	return true;
+/* Percentiles over the ring, in microseconds after the boundary. */
+static void
+reportlatency() {
+	static long long v[LAT_MAX];
+	int n = lat.n < LAT_MAX ? (int)lat.n : LAT_MAX, k;
+	if (!n) {
+		return;
+	}
+	printf("latency of the last %d updates:\n", n);
+	for (int i = 0; i < n; ++i) {
+		v[i] = lat.ring[i].wake;
+	}
+	latstage("woken", v, n);
+	for (int i = 0; i < n; ++i) {
+		v[i] = lat.ring[i].render;
+	}
+	latstage("rendered", v, n);
+	for (int i = k = 0; i < n; ++i) {
+		if (lat.ring[i].acked) {
+			v[k++] = lat.ring[i].ack;
+		}
+	}
+	latstage("acknowledged", v, k);
+	fflush(stdout);
 }
 
-static bool
-draw() {
-	time_t t = time(NULL);
-	struct tm *tmp;
-	bool dirty = false;
-	if (!(tmp = localtime(&t))) {
-		err(1, "ERROR: localtime");
+static void
+reporthist() {
+	for (int i = 0; i < HIST_BUCKETS; ++i) {
+		if (stats.hist[i]) {
+			break;
+		} else if (i == HIST_BUCKETS - 1) {
+			return;
+		}
 	}
-	dirty = drawtext(&dc.text1, tmp, dirty);
-	dirty = drawtext(&dc.text2, tmp, dirty);
-	XSync(dc.dpy, 0);
-	return dirty;
+	printf("boundary to copy:");
+	for (int i = 0; i < HIST_BUCKETS - 1; ++i) {
+		if (stats.hist[i]) {
+			printf(" <%ldus:%lu", 64L << i, stats.hist[i]);
+		}
+	}
+	if (stats.hist[HIST_BUCKETS - 1]) {
+		printf(" more:%lu", stats.hist[HIST_BUCKETS - 1]);
+	}
+	printf("\n");
 }
 
+/* Statistics are kept per monotonic hour, as the wall clock may jump. */
 static void
-setup() {
-	if (!(dc.dpy = XOpenDisplay(NULL))) {
-		errx(1, "Cannot open display");
+report() {
+	time_t t = uptime();
+	time_t elapsed = t - stats.since;
+	if (elapsed < 3600) {
+		return;
 	}
-	dc.screen = DefaultScreen(dc.dpy);
-	dc.x = 0;
-	dc.y = 0;
-	dc.w = DisplayWidth(dc.dpy, dc.screen);
-	dc.h = DisplayHeight(dc.dpy, dc.screen);
-	dc.root = RootWindow(dc.dpy, dc.screen);
-	dc.cmap = DefaultColormap(dc.dpy, dc.screen);
-	dc.vis = DefaultVisual(dc.dpy, dc.screen);
-	if (XineramaIsActive(dc.dpy)) {
-		int n, i = 0;
-		XineramaScreenInfo *info = XineramaQueryScreens(dc.dpy, &n);
-		if (args.screen != -1) {
-			if (args.screen >= n) {
-				errx(1, "%d exceeds the number of screens (%d)", args.screen, n);
+	if (args.debug > 1) {
+		printf("wakeups: %lu/h\n", stats.wakeups * 3600 / elapsed);
+		if (stats.clocksets) {
+			printf("clock set: %lu times\n", stats.clocksets);
+		}
+		if (stats.ticks) {
+			printf("lateness: mean %lldus, max %lldus",
+			       stats.latens / 1000 / stats.ticks, stats.maxlatens / 1000);
+			if (args.slack) {
+				/* how much of the slack the kernel used to batch us */
+				printf(", %lld%% of %dms slack",
+				       stats.latens / stats.ticks / 10000 / args.slack, args.slack);
 			}
-			i = args.screen;
-		} else {
-			for (i = 0; i < n; ++i) {
-				if (info[i].x_org == 0) {
-					break;
+			printf("\n");
+		}
+		printf("pixels copied: %llu/h\n", stats.pixels * 3600 / elapsed);
+		printf("pixels damaged: %llu/h (%llu/h with full-width bands)\n",
+		       stats.inked * 3600 / elapsed, stats.banded * 3600 / elapsed);
+		printf("line redraws: %lu/h, %lu/h\n",
+		       dc.text1.redraws * 3600 / elapsed, dc.text2.redraws * 3600 / elapsed);
+		printf("round-trips: %lu/h", stats.roundtrips * 3600 / elapsed);
+		if (stats.roundtrips) {
+			printf(", %lldus each", stats.roundtripns / 1000 / stats.roundtrips);
+		}
+		printf("\n");
+		reportframes();
+		reportsw();
+		reporthist();
+		reportpixmaps();
+		reportusage();
+		if (stats.updates) {
+			printf("render: %lldus, %lu requests, %llu bytes per update (%s)\n",
+			       stats.renderns / 1000 / stats.updates, stats.requests / stats.updates,
+			       stats.reqbytes / stats.updates,
+			       dc.text1.atlas ? "atlas" : "xft");
+		}
+		fflush(stdout);
+	}
+	stats.wakeups = 0;
+	stats.clocksets = 0;
+	stats.ticks = 0;
+	stats.latens = 0;
+	stats.maxlatens = 0;
+	stats.pixels = 0;
+	stats.inked = 0;
+	stats.banded = 0;
+	dc.text1.redraws = 0;
+	dc.text2.redraws = 0;
+	stats.updates = 0;
+	stats.requests = 0;
+	stats.reqbytes = 0;
+	stats.renderns = 0;
+	stats.roundtrips = 0;
+	stats.roundtripns = 0;
+	stats.frames = 0;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &stats.cpu);
+	stats.servercpu = servercpu();
+	stats.swframes = 0;
+	stats.swrenderns = 0;
+	stats.swsubmitns = 0;
+	stats.swskewns = 0;
+	stats.maxswskewns = 0;
+	stats.shmwaits = 0;
+	memset(stats.hist, 0, sizeof(stats.hist));
+	stats.since = t;
+}
+
+/* Lay the heads out again after the screen configuration has changed.
+ * Fonts, colors and atlases stay as they are, and a head keeps the
+ * pixmaps of a previous head of the same size, picture and all. */
+static void
+relayout() {
+	struct head_t *old = dc.heads;
+	int nold = dc.nheads, kept = 0;
+	struct timespec t0, t1;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	queryheads();
+	for (int i = 0; i < dc.nheads; ++i) {
+		struct head_t *head = &dc.heads[i];
+		layout(head);
+		head->damage = XCreateRegion();
+		for (int j = 0; j < nold; ++j) {
+			struct head_t *o = &old[j];
+			if (args.rootbg) {
+				/* the one pixmap, redrawn from scratch if it still fits */
+				if (!i && !j && o->band.width == head->band.width && o->band.height == head->band.height) {
+					head->da = o->da;
+					head->draw = o->draw;
+					o->da = None;
+					XSetForeground(dc.dpy, dc.gc, dc.bg.pixel);
+					XFillRectangle(dc.dpy, head->da, dc.gc, 0, 0, head->band.width, head->band.height);
+				}
+			} else if (o->da && o->w == head->w && o->h == head->h) {
+				/* same size, so the same band and the same picture */
+				head->da = o->da;
+				head->draw = o->draw;
+				head->back = o->back;
+				head->backdraw = o->backdraw;
+				head->stale = o->stale;
+				head->ximg = o->ximg;
+				head->shm = o->shm;
+				if (head->shm.shmaddr) {
+					/* where XShmPutImage finds the segment */
+					head->ximg->obdata = (char*)&head->shm;
 				}
+				head->img = o->img;
+				o->ximg = NULL;
+				head->text1 = o->text1;
+				head->text2 = o->text2;
+				o->da = None;
+				++kept;
+				break;
 			}
 		}
-		dc.x = info[i].x_org;
-		dc.y = info[i].y_org;
-		dc.w = info[i].width;
-		dc.h = info[i].height;
-		XFree(info);
+		if (!head->da) {
+			mkpixmap(head);
+		}
+		if (args.threads && !head->ximg) {
+			mkimage(head);
+		}
+		if (args.rootbg || !head->text1.advance) {
+			drawhead(head);
+			if (args.threads) {
+				swdraw();
+			}
+		}
+		if (args.precise && !head->back) {
+			mkback(head);
+		}
+	}
+
+	for (int j = 0; j < nold; ++j) {
+		struct head_t *o = &old[j];
+		if (o->da && (!args.rootbg || !j)) {
+			XftDrawDestroy(o->draw);
+			if (args.rootbg) {
+				setrootpmap(dc.heads->da, false);
+			}
+			XFreePixmap(dc.dpy, o->da);
+		}
+		if (o->da && o->back) {
+			XftDrawDestroy(o->backdraw);
+			XFreePixmap(dc.dpy, o->back);
+		}
+		if (o->ximg) {
+			freeimage(o);
+		}
+		XDestroyRegion(o->damage);
+	}
+	free(old);
+
+	if (args.rootbg) {
+		XClearWindow(dc.dpy, dc.root);
+	} else {
+		damage(0, 0, DisplayWidth(dc.dpy, dc.screen), DisplayHeight(dc.dpy, dc.screen));
 	}
+	flush();
 	if (args.debug > 1) {
-		printf("x=%d y=%d w=%d h=%d\n", dc.x, dc.y, dc.w, dc.h);
+		roundtrip();
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		printf("relayout: %d heads, %d kept their pixmaps, %lldus\n",
+		       dc.nheads, kept, nsec(&t0, &t1) / 1000);
+		fflush(stdout);
 	}
-	dc.da = XCreatePixmap(dc.dpy, dc.root, dc.w, dc.h, DefaultDepth(dc.dpy, dc.screen));
-	XGCValues gcv = { 0 };
-	dc.gc = XCreateGC(dc.dpy, dc.root, GCGraphicsExposures, &gcv);
-	if (!XAllocNamedColor(dc.dpy, dc.cmap, args.background, &dc.bg, &dc.bg)) {
-		errx(1, "Cannot load color: %s", args.background);
+}
+
+/* Read and classify everything the server has sent so far, so that the
+ * connection is not left readable and the next poll() can block. */
+static bool
+handleevents() {
+	XEvent ev;
+	bool dirty = false, changed = false;
+	while (XPending(dc.dpy)) {
+		XNextEvent(dc.dpy, &ev);
+		switch (ev.type) {
+		case Expose:
+			damage(ev.xexpose.x, ev.xexpose.y, ev.xexpose.width, ev.xexpose.height);
+			dirty = true;
+			break;
+		default:
+			if (dc.shmpending && ev.type == dc.shmevbase + ShmCompletion) {
+				--dc.shmpending;
+			} else if (dc.rrevbase < 0) {
+				break;
+			} else if (ev.type == dc.rrevbase + RRScreenChangeNotify) {
+				XRRUpdateConfiguration(&ev);
+				changed = true;
+			} else if (ev.type == dc.rrevbase + RRNotify
+			        && ((XRRNotifyEvent*)&ev)->subtype == RRNotify_OutputChange) {
+				changed = true;
+			}
+			break;
+		}
+	}
+	/* a change of monitors comes as a burst of events */
+	if (changed) {
+		relayout();
 	}
+	return dirty;
+}
 
-	initline(&dc.text1, &args.text1);
-	initline(&dc.text2, &args.text2);
-	dc.text1.y = (dc.h - dc.text1.height - dc.text2.height) / 2 + args.text1.dy;
-	dc.text2.y = dc.text1.y + dc.text1.height + args.text2.dy;
-	XSetForeground(dc.dpy, dc.gc, dc.bg.pixel);
-	XFillRectangle(dc.dpy, dc.da, dc.gc, dc.x, dc.y, dc.w, dc.h);
+/* Update for the boundary that has just passed, noting how late it is. */
+static void
+tick(const struct timespec *now, bool ontime) {
+	const struct timespec *next = timernext();
+	if (ontime) {
+		long long late = nsec(next, now);
+		if (late >= 0) {
+			++stats.ticks;
+			stats.latens += late;
+			if (late > stats.maxlatens) {
+				stats.maxlatens = late;
+			}
+		}
+	}
+	if (draw(now)) {
+		dc.dirty = true;
+		if (ontime && nsec(next, now) >= 0) {
+			latrecord(next, now);
+		}
+	}
+	report();
+}
+
+/* Render the coming boundary into the back pixmap while the current
+ * frame is still up, sleep until the boundary, and only then copy. */
+static void
+precisetick() {
+	struct timespec boundary = *timernext(), done;
 
-	XSelectInput(dc.dpy, dc.root, ExposureMask);
+	clock_gettime(CLOCK_REALTIME, &done);
+	if (nsec(&boundary, &done) >= 0) {
+		/* too late to render ahead */
+		tick(&done, true);
+		return;
+	}
+	/* bring the back pixmaps up to what is on screen, then swap */
+	for (int i = 0; i < dc.nheads; ++i) {
+		struct head_t *head = &dc.heads[i];
+		Pixmap pm = head->da;
+		XftDraw *xd = head->draw;
+		XRectangle r = head->stale;
+		if (cliprect(&r, head->band.width, head->band.height)) {
+			XCopyArea(dc.dpy, head->da, head->back, dc.gc, r.x, r.y, r.width, r.height, r.x, r.y);
+		}
+		head->stale = (XRectangle){ 0 };
+		head->da = head->back;
+		head->draw = head->backdraw;
+		head->back = pm;
+		head->backdraw = xd;
+	}
+	bool dirty = draw(&boundary);
+	int i = dirty ? latrecord(&boundary, &done) : -1;
+	XFlush(dc.dpy);
+
+	while (clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &boundary, NULL) == EINTR) {
+		;
+	}
+	if (dirty) {
+		flush();
+		if (!args.latency) {
+			roundtrip();
+			latack(i);
+		}
+		clock_gettime(CLOCK_REALTIME, &done);
+		long long us = nsec(&boundary, &done) / 1000;
+		int b = 0;
+		while (b < HIST_BUCKETS - 1 && us >= 64LL << b) {
+			++b;
+		}
+		++stats.hist[b];
+	}
+	report();
+}
+
+/* The timer has expired or the clock was set; timer.c arms it again. */
+static void
+update(const struct timespec *now, bool ontime, void *arg) {
+	if (!ontime) {
+		++stats.clocksets;
+	}
+	if (args.precise && ontime) {
+		precisetick();
+	} else {
+		tick(now, ontime);
+	}
+}
+
+static void
+ontimer(int fd, unsigned events, void *arg) {
+	if (timerhandle(update, NULL) < 0) {
+		err(1, "ERROR: timerfd");
+	}
+}
+
+/* The epoll timeout, unlike a timerfd, honours the timer slack, which
+ * lets the kernel batch our wakeup with others. */
+static int
+timeout() {
+	struct timespec now;
+	if (XQLength(dc.dpy)) {
+		/* events may already sit in Xlib's queue after an XSync */
+		return 0;
+	}
+	if (!args.slack) {
+		return -1;
+	}
+	timernow(&now);
+	long long ms = (nsec(&now, timernext()) + 999999) / 1000000;
+	return ms < 0 ? 0 : ms > INT32_MAX ? INT32_MAX : (int)ms;
+}
+
+/* Step out of the way of everything else on the machine. */
+static void
+lowimpact() {
+	struct sched_param sp = { 0 };
+	if (sched_setscheduler(0, SCHED_IDLE, &sp) < 0) {
+		warn("WARNING: SCHED_IDLE");
+	}
+	if (prctl(PR_SET_TIMERSLACK, args.slack * 1000000UL, 0, 0, 0) < 0) {
+		warn("WARNING: PR_SET_TIMERSLACK");
+	}
+	if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0,
+	            IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT) < 0) {
+		warn("WARNING: ioprio_set");
+	}
+}
+
+/* Hear of monitors coming and going, and of changes of resolution. */
+static void
+watchscreens() {
+	int errbase;
+	if (XRRQueryExtension(dc.dpy, &dc.rrevbase, &errbase)) {
+		XRRSelectInput(dc.dpy, dc.root, RRScreenChangeNotifyMask | RROutputChangeNotifyMask);
+	} else {
+		dc.rrevbase = -1;
+	}
+}
 
-	draw();
-	XCopyArea(dc.dpy, dc.da, dc.root, dc.gc, 0, 0, dc.w, dc.h, dc.x, dc.y);
-	XSync(dc.dpy, 0);
+/* Get nothing between the boundary and the copy: no page faults, no
+ * timer slack and, with a priority, no other task. */
+static void
+realtime() {
+	volatile char stack[PREFAULT_STACK];
+	/* faults in everything mapped so far, and whatever is mapped later */
+	if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
+		warn("WARNING: mlockall");
+	}
+	memset((char *)stack, 0, sizeof(stack));
+	if (prctl(PR_SET_TIMERSLACK, 1UL, 0, 0, 0) < 0) {
+		warn("WARNING: PR_SET_TIMERSLACK");
+	}
+	if (args.rtprio) {
+		struct sched_param sp = { .sched_priority = args.rtprio };
+		if (sched_setscheduler(0, SCHED_FIFO, &sp) < 0) {
+			warn("WARNING: SCHED_FIFO");
+		}
+	}
+}
 
+static void
+ontz(int fd, unsigned events, void *arg) {
+	if (tzhandle()) {
+		/* the zone changed under us */
+		struct timespec now;
+		timernow(&now);
+		if (draw(&now)) {
+			dc.dirty = true;
+		}
+		if (timerarm(&now) < 0) {
+			err(1, "ERROR: timerfd_settime");
+		}
+	}
 }
 
 static void
-catch(int signal) {
-	running = false;
+onsignal(int signo, void *arg) {
+	if (signo == SIGUSR1) {
+		reportlatency();
+	} else {
+		running = false;
+	}
 }
 
 static void
 cleanup() {
-	XClearWindow(dc.dpy, dc.root);
-	XFreePixmap(dc.dpy, dc.da);
+	evcleanup();
+	timercleanup();
+	tzcleanup();
+	if (args.rootbg) {
+		setrootpmap(None, false);
+	} else {
+		XClearWindow(dc.dpy, dc.root);
+	}
+	for (int i = 0; i < dc.nheads; ++i) {
+		struct head_t *head = &dc.heads[i];
+		if (!args.rootbg || !i) {
+			XftDrawDestroy(head->draw);
+			XFreePixmap(dc.dpy, head->da);
+		}
+		if (head->back) {
+			XftDrawDestroy(head->backdraw);
+			XFreePixmap(dc.dpy, head->back);
+		}
+		if (head->ximg) {
+			freeimage(head);
+		}
+		XDestroyRegion(head->damage);
+	}
+	free(dc.heads);
+	poolcleanup();
+	rfontfree(&dc.text1.rfont);
+	rfontfree(&dc.text2.rfont);
+	if (dc.text1.atlas) {
+		XFreePixmap(dc.dpy, dc.text1.atlas->pm);
+		free(dc.text1.atlas);
+	}
 	XftColorFree(dc.dpy, dc.vis, dc.cmap, &dc.text1.color);
 	XftColorFree(dc.dpy, dc.vis, dc.cmap, &dc.text2.color);
+	fmtfree(&dc.text1.fmt);
+	fmtfree(&dc.text2.fmt);
+	XFreeGC(dc.dpy, dc.gc);
+	XCloseDisplay(dc.dpy);
+}
+
+/* Leave the background pixmap on the server for good, and free what a
+ * previous run left there the same way. Everything else is released, as
+ * all resources of a retained client outlive it. */
+static void
+retain() {
+	XftDrawDestroy(dc.heads->draw);
+	if (dc.text1.atlas) {
+		XFreePixmap(dc.dpy, dc.text1.atlas->pm);
+		free(dc.text1.atlas);
+	}
+	XftFontClose(dc.dpy, dc.text1.xfont);
+	XftFontClose(dc.dpy, dc.text2.xfont);
+	for (int i = 0; i < dc.nheads; ++i) {
+		XDestroyRegion(dc.heads[i].damage);
+	}
 	XFreeGC(dc.dpy, dc.gc);
+	if (dc.prevpm != None && dc.prevpm != dc.heads->da) {
+		XKillClient(dc.dpy, dc.prevpm);
+	}
+	XSetCloseDownMode(dc.dpy, RetainPermanent);
 	XCloseDisplay(dc.dpy);
 }
 
 static void
 usage() {
-	printf("usage: [-s screen] [-b background] [-Ff font] [-Cc color] [-Dd datefmt] [-Yy y-offset]\n");
+	printf("usage: [-a] [-A] [-l] [-L slack] [-o] [-P prio] [-r fps] [-R] [-g gamma] [-s screen] [-S] [-T threads] [-b background] [-Ff font] [-Cc color] [-Dd datefmt] [-Yy y-offset]\n");
 	exit(1);
 }
 
@@ -252,6 +2051,8 @@ int
 main(int argc, char *argv[]) {
 	bool daemonize = true;
 
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
 	ARGBEGIN {
 	case 's':
 		args.screen = atoi(EARGF(usage()));
@@ -259,6 +2060,36 @@ main(int argc, char *argv[]) {
 	case 'q':
 		--args.debug;
 		break;
+	case 'a':
+		args.allheads = true;
+		break;
+	case 'A':
+		args.atlas = true;
+		break;
+	case 'l':
+		args.latency = true;
+		break;
+	case 'R':
+		args.rootbg = true;
+		break;
+	case 'L':
+		args.slack = atoi(EARGF(usage()));
+		args.slack = args.slack < 1 ? 1 : args.slack > 999 ? 999 : args.slack;
+		break;
+	case 'P':
+		args.precise = true;
+		args.rtprio = atoi(EARGF(usage()));
+		args.rtprio = args.rtprio < 0 ? 0 : args.rtprio > 99 ? 99 : args.rtprio;
+		break;
+	case 'r':
+		args.fps = atoi(EARGF(usage()));
+		args.fps = args.fps < 1 ? 1 : args.fps > 1000 ? 1000 : args.fps;
+		break;
+	case 'o':
+		args.oneshot = true;
+		args.rootbg = true;
+		daemonize = false;
+		break;
 	case 'v':
 		++args.debug;
 		break;
@@ -289,6 +2120,17 @@ main(int argc, char *argv[]) {
 	case 'y':
 		args.text2.dy = atoi(EARGF(usage()));
 		break;
+	case 'g':
+		args.gamma = atof(EARGF(usage()));
+		args.gamma = args.gamma < 0.1 ? 0.1 : args.gamma > 10 ? 10 : args.gamma;
+		break;
+	case 'S':
+		args.shm = true;
+		break;
+	case 'T':
+		args.threads = atoi(EARGF(usage()));
+		args.threads = args.threads < 1 ? 1 : args.threads > 64 ? 64 : args.threads;
+		break;
 	case 'x':
 		daemonize = false;
 		break;
@@ -296,6 +2138,16 @@ main(int argc, char *argv[]) {
 		usage();
 	} ARGEND;
 
+	if (args.precise && (args.slack || args.rootbg)) {
+		errx(1, "ERROR: -P cannot be combined with -L, -o or -R");
+	}
+	if (args.shm && !args.threads) {
+		args.threads = 1;
+	}
+	if (args.threads && args.rootbg) {
+		errx(1, "ERROR: -S and -T cannot be combined with -o or -R");
+	}
+
 	if (daemonize) {
 		switch (fork()) {
 		case -1:
@@ -314,38 +2166,77 @@ main(int argc, char *argv[]) {
 		warn("WARNING: setlocale failed");
 	}
 
-	if (signal(SIGINT,  catch) == SIG_ERR
-	 || signal(SIGHUP,  catch) == SIG_ERR
-	 || signal(SIGTERM, catch) == SIG_ERR) {
-		warn("WARNING: unable to catch signals");
+	sched.tzfd = tzinit();
+	if (!args.oneshot) {
+		int sigs[] = { SIGINT, SIGHUP, SIGTERM, SIGUSR1 };
+		if (evinit() < 0) {
+			err(1, "ERROR: epoll_create");
+		}
+		if (evsignal(sigs, sizeof(sigs) / sizeof(sigs[0]), onsignal, NULL) < 0) {
+			warn("WARNING: unable to catch signals");
+		}
 	}
 
 	setup();
+	if (args.oneshot) {
+		retain();
+		if (args.debug > 1) {
+			reportusage();
+		}
+		return 0;
+	}
+	if (args.slack) {
+		lowimpact();
+	}
+	if (args.precise) {
+		for (int i = 0; i < dc.nheads; ++i) {
+			mkback(&dc.heads[i]);
+		}
+		realtime();
+	}
+	/* threads take the policy and timer slack of the one starting them,
+	 * so the workers come after lowimpact() and realtime(); until then
+	 * this thread draws alone */
+	if (args.threads && poolinit(args.threads - 1) < 0) {
+		err(1, "ERROR: poolinit");
+	}
+	watchscreens();
+	initsched();
 
-	struct pollfd pfd = {
-		.fd = ConnectionNumber(dc.dpy),
-		.events = POLLIN,
-	};
+	if (evadd(ConnectionNumber(dc.dpy), EPOLLIN, NULL, NULL) < 0
+	 || evadd(sched.fd, EPOLLIN, ontimer, NULL) < 0
+	 || (sched.tzfd >= 0 && evadd(sched.tzfd, EPOLLIN, ontz, NULL) < 0)) {
+		err(1, "ERROR: epoll_ctl");
+	}
 
 	while (running) {
-		bool dirty = false;
-		switch(poll(&pfd, 1, 1000)) {
-		case -1:
-			warn("ERROR: poll");
-			break;
-		case 0:
-			dirty = draw();
-			break;
-		default:
-			dirty = true;
+		if (evwait(timeout()) < 0) {
+			if (errno != EINTR) {
+				warn("ERROR: epoll_wait");
+			}
+			continue;
 		}
-		if (dirty) {
-			XCopyArea(dc.dpy, dc.da, dc.root, dc.gc, 0, 0, dc.w, dc.h, dc.x, dc.y);
-			XSync(dc.dpy, 0);
+		++stats.wakeups;
+		if (args.slack && timerdue(update, NULL) < 0) {
+			err(1, "ERROR: timerfd_settime");
+		}
+		if (handleevents()) {
+			dc.dirty = true;
+		}
+		if (dc.dirty) {
+			flush();
+			dc.dirty = false;
 		}
 	}
 
 	cleanup();
+	if (args.debug > 1) {
+		reportframes();
+		reportsw();
+		reporthist();
+		reportlatency();
+		reportusage();
+	}
 
 	return 0;
 }